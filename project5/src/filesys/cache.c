@@ -1,14 +1,46 @@
+#include <crc32c.h>
 #include <debug.h>
+#include <stdio.h>
 #include <string.h>
 #include "filesys/cache.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "filesys/snapshot.h"
 #include "threads/synch.h"
 struct lock bc_lock;
+static size_t journaled_cnt;  /* Entries with journaled set. */
+static bool cksum_on;         /* Maintain and verify checksums? */
+static void buffer_cache_commit_locked (void);
 void buffer_cache_init (void)
 {
   lock_init (&bc_lock);
-  for (int i = 0; i < NUM_CACHE;i++)
+  journaled_cnt = 0;
+  cksum_on = false;
+  for (int i = 0; i < NUM_CACHE;i++) {
     cache[i].valid_bit = false;
+    cache[i].journaled = false;
+  }
+}
+/* Turns checksumming of metadata sectors on or off. */
+void buffer_cache_set_cksum (bool on)
+{
+  cksum_on = on;
+}
+/* Returns the checksum stored for sector contents BUFFER.  Zero
+   is left for sectors never written with a checksum, such as
+   freshly zeroed directory blocks, which are not verified. */
+static uint32_t sector_cksum (const uint8_t *buffer)
+{
+  uint32_t crc = crc32c (0, buffer, CKSUM_OFS);
+  return crc != 0 ? crc : 1;
+}
+/* Stores the checksum into ENT's buffer before it is written out. */
+static void buffer_cache_seal (struct buffer_cache_entry *ent)
+{
+  if (cksum_on && ent->cksum) {
+    uint32_t crc = sector_cksum (ent->buffer);
+    memcpy (ent->buffer + CKSUM_OFS, &crc, sizeof crc);
+  }
 }
 struct buffer_cache_entry* buffer_cache_select_victim (void)
 {
@@ -19,9 +51,12 @@ struct buffer_cache_entry* buffer_cache_select_victim (void)
   for(;;) {
     if (cache[cindex].valid_bit == false)
       return &(cache[cindex]);
-    if (cache[cindex].refer_bit == true)
-      cache[cindex].refer_bit = false;
-    else break;
+    // journaled entries stay pinned until their transaction commits
+    if (cache[cindex].journaled == false) {
+      if (cache[cindex].refer_bit == true)
+        cache[cindex].refer_bit = false;
+      else break;
+    }
     cindex = (cindex + 1)% NUM_CACHE;
   }
   ent = &cache[cindex];
@@ -37,53 +72,166 @@ void buffer_cache_flush_entry (struct buffer_cache_entry *ent)
   if(!(ent != NULL && ent->valid_bit == true))
 	  exit(-1);
   if (ent->dirty_bit) {
-    block_write (fs_device, ent->disk_sector, ent->buffer);
+    buffer_cache_seal (ent);
+    buffer_cache_write_home (ent->disk_sector, ent->buffer);
     ent->dirty_bit = false;
   }
 }
-void buffer_cache_terminate()
+/* Writes SOURCE to SECTOR on disk, first preserving the sector's
+   old contents if a snapshot still needs them.  Called with bc_lock
+   held, or before the file system is in use. */
+void buffer_cache_write_home (block_sector_t sector, const void *source)
+{
+  struct buffer_cache_entry *ent;
+  block_sector_t saved;
+  if (snapshot_preserve (sector, &saved)) {
+    // the sector holding the copy was free; forget any stale contents
+    ent = buffer_cache_lookup (saved);
+    if (ent != NULL) {
+      if (ent->journaled)
+        journaled_cnt--;
+      ent->journaled = false;
+      ent->dirty_bit = false;
+      ent->valid_bit = false;
+    }
+  }
+  block_write (fs_device, sector, source);
+}
+/* Commits the journal and writes every dirty entry home. */
+void buffer_cache_flush_all (void)
 {
   lock_acquire (&bc_lock);
+  buffer_cache_commit_locked ();
   for (int i = 0; i < NUM_CACHE;i++)
-  {
-    if (cache[i].valid_bit == true) 
-    	buffer_cache_flush_entry(&(cache[i]));
-  }
+    if (cache[i].valid_bit == true)
+      buffer_cache_flush_entry(&(cache[i]));
   lock_release (&bc_lock);
 }
-void buffer_cache_read (block_sector_t sector, void *target)
+void buffer_cache_terminate()
+{
+  buffer_cache_flush_all ();
+}
+/* Returns the entry for SECTOR, reading it from disk on a miss.
+   *FILLED is set to whether it was read. */
+static struct buffer_cache_entry *buffer_cache_get (block_sector_t sector, bool *filled)
 {
-  lock_acquire (&bc_lock);
   struct buffer_cache_entry *ent = buffer_cache_lookup (sector);
+  *filled = ent == NULL;
   if (ent == NULL) {
     ent = buffer_cache_select_victim ();
     ASSERT (ent != NULL && ent->valid_bit == false);
     ent->dirty_bit = false;
+    ent->journaled = false;
+    ent->cksum = false;
     ent->valid_bit = true;
     ent->disk_sector = sector;
     block_read (fs_device, sector, ent->buffer);
   }
   ent->refer_bit = true;
+  return ent;
+}
+void buffer_cache_read (block_sector_t sector, void *target)
+{
+  bool filled;
+  lock_acquire (&bc_lock);
+  struct buffer_cache_entry *ent = buffer_cache_get (sector, &filled);
   memcpy (target, ent->buffer, BLOCK_SECTOR_SIZE);
   lock_release (&bc_lock);
 }
-void buffer_cache_write (block_sector_t sector, const void *source)
+/* Reads checksummed metadata.  A sector is verified when it comes
+   in from disk; returns false, after reporting it, if its contents
+   do not match the stored checksum.  A mismatched sector is not
+   kept, so the next read verifies it again instead of hitting the
+   cache, and it can't be written back under a fresh checksum. */
+bool buffer_cache_read_meta (block_sector_t sector, void *target)
 {
+  bool filled, ok = true;
+  uint32_t stored;
+  lock_acquire (&bc_lock);
+  struct buffer_cache_entry *ent = buffer_cache_get (sector, &filled);
+  if (filled && cksum_on) {
+    memcpy (&stored, ent->buffer + CKSUM_OFS, sizeof stored);
+    ok = stored == 0 || stored == sector_cksum (ent->buffer);
+  }
+  ent->cksum = true;
+  memcpy (target, ent->buffer, BLOCK_SECTOR_SIZE);
+  if (!ok)
+    ent->valid_bit = false;
+  lock_release (&bc_lock);
+  if (!ok)
+    printf ("cache: sector %"PRDSNu": checksum mismatch\n", sector);
+  return ok;
+}
+static void buffer_cache_write_entry (block_sector_t sector, const void *source, bool meta, bool cksum)
+{
+  bool filled;
   lock_acquire(&bc_lock);
-  struct buffer_cache_entry *ent = buffer_cache_lookup (sector);
-  if (ent == NULL) {
-    ent = buffer_cache_select_victim ();
-    ASSERT (ent != NULL && ent->valid_bit == false);
-    ent->dirty_bit = false;
-    ent->valid_bit = true;
-    ent->disk_sector = sector;
-    block_read (fs_device, sector, ent->buffer);
+  struct buffer_cache_entry *ent = buffer_cache_get (sector, &filled);
+  // journal_begin() reserves room for every open operation, and
+  // operations are split to fit, so the journal can't fill up here;
+  // committing now would log other operations half done
+  if (meta && journal_enabled () && !ent->journaled) {
+    ASSERT (journaled_cnt < JOURNAL_MAX);
+    ent->journaled = true;
+    journaled_cnt++;
   }
-  ent->refer_bit = true;
   ent->dirty_bit = true;
+  ent->cksum = cksum;
   memcpy (ent->buffer, source, BLOCK_SECTOR_SIZE);
   lock_release (&bc_lock);
 }
+/* Writes file data; it may reach the disk at any time. */
+void buffer_cache_write (block_sector_t sector, const void *source)
+{
+  buffer_cache_write_entry (sector, source, false, false);
+}
+/* Writes file system metadata as part of the running journal
+   transaction; it stays in the cache until the transaction commits.
+   CKSUM says whether the sector carries a checksum. */
+void buffer_cache_write_meta (block_sector_t sector, const void *source, bool cksum)
+{
+  buffer_cache_write_entry (sector, source, true, cksum);
+}
+/* Returns the number of sectors in the running journal transaction. */
+size_t buffer_cache_journaled (void)
+{
+  size_t cnt;
+  lock_acquire (&bc_lock);
+  cnt = journaled_cnt;
+  lock_release (&bc_lock);
+  return cnt;
+}
+/* Commits the running journal transaction: logs every journaled
+   entry, writes each one home, then empties the journal. */
+void buffer_cache_commit (void)
+{
+  lock_acquire (&bc_lock);
+  buffer_cache_commit_locked ();
+  lock_release (&bc_lock);
+}
+static void buffer_cache_commit_locked (void)
+{
+  static block_sector_t sectors[JOURNAL_MAX];
+  static const void *images[JOURNAL_MAX];
+  size_t cnt = 0;
+  if (journaled_cnt == 0)
+    return;
+  for (int i = 0; i < NUM_CACHE;i++)
+    if (cache[i].valid_bit && cache[i].journaled) {
+      buffer_cache_seal (&cache[i]);
+      sectors[cnt] = cache[i].disk_sector;
+      images[cnt++] = cache[i].buffer;
+    }
+  ASSERT (cnt == journaled_cnt);
+  journal_write (sectors, images, cnt);
+  for (int i = 0; i < NUM_CACHE;i++)
+    if (cache[i].valid_bit && cache[i].journaled) {
+      cache[i].journaled = false;
+      buffer_cache_flush_entry (&cache[i]);
+    }
+  journal_clear ();
+  journaled_cnt = 0;
+}
 struct buffer_cache_entry* buffer_cache_lookup (block_sector_t sector)
 {
   for (int i = 0; i < NUM_CACHE;i++)
@@ -11,13 +11,22 @@ struct buffer_cache_entry {
   uint8_t buffer[BLOCK_SECTOR_SIZE];
   bool dirty_bit;    
   bool refer_bit;    
+  bool journaled;    /* Part of the uncommitted journal transaction. */
+  bool cksum;        /* Holds checksummed metadata. */
 };
 #define NUM_CACHE 64
 static struct buffer_cache_entry cache[NUM_CACHE];
 void buffer_cache_init();
 void buffer_cache_terminate();
+void buffer_cache_set_cksum (bool on);
 void buffer_cache_read (block_sector_t sector,void*cont);
+bool buffer_cache_read_meta (block_sector_t sector,void*cont);
 void buffer_cache_write (block_sector_t sector,const void*cont);
+void buffer_cache_write_meta (block_sector_t sector,const void*cont,bool cksum);
+size_t buffer_cache_journaled (void);
+void buffer_cache_commit (void);
+void buffer_cache_flush_all (void);
+void buffer_cache_write_home (block_sector_t sector,const void*cont);
 struct buffer_cache_entry* buffer_cache_lookup(block_sector_t sector);
 struct buffer_cache_entry* buffer_cache_select_victim();
 void buffer_cache_flush_entry(struct buffer_cache_entry*ent);
@@ -0,0 +1,163 @@
+#include "filesys/dedup.h"
+#include <crc32c.h>
+#include <hash.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Most sectors indexed at once.  Sectors written after the index
+   fills up are simply not candidates for sharing. */
+#define DEDUP_MAX 4096
+
+/* An indexed data sector.  Only the first sector seen with a
+   given checksum is indexed. */
+struct dedup_entry
+  {
+    struct hash_elem crc_elem;          /* Element in by_crc. */
+    struct hash_elem sector_elem;       /* Element in by_sector. */
+    uint32_t crc;                       /* CRC-32C of the contents. */
+    block_sector_t sector;              /* Sector holding them. */
+  };
+
+static struct hash by_crc;              /* Entries by checksum. */
+static struct hash by_sector;           /* Entries by sector. */
+static size_t entry_cnt;                /* Number of entries. */
+static bool enabled;                    /* Deduplicating? */
+static struct lock dedup_lock;          /* Guards the index. */
+
+static unsigned
+crc_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct dedup_entry, crc_elem)->crc);
+}
+
+static bool
+crc_less (const struct hash_elem *a, const struct hash_elem *b,
+          void *aux UNUSED)
+{
+  return (hash_entry (a, struct dedup_entry, crc_elem)->crc
+          < hash_entry (b, struct dedup_entry, crc_elem)->crc);
+}
+
+static unsigned
+sector_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct dedup_entry, sector_elem)->sector);
+}
+
+static bool
+sector_less (const struct hash_elem *a, const struct hash_elem *b,
+             void *aux UNUSED)
+{
+  return (hash_entry (a, struct dedup_entry, sector_elem)->sector
+          < hash_entry (b, struct dedup_entry, sector_elem)->sector);
+}
+
+/* Initializes the deduplication module, initially disabled. */
+void
+dedup_init (void)
+{
+  hash_init (&by_crc, crc_hash, crc_less, NULL);
+  hash_init (&by_sector, sector_hash, sector_less, NULL);
+  lock_init (&dedup_lock);
+  entry_cnt = 0;
+  enabled = false;
+}
+
+/* Turns deduplication on, for a file system formatted with it. */
+void
+dedup_enable (void)
+{
+  enabled = true;
+}
+
+/* Returns true if data sectors are being deduplicated. */
+bool
+dedup_enabled (void)
+{
+  return enabled;
+}
+
+/* Looks for an indexed sector holding the BLOCK_SECTOR_SIZE bytes
+   in DATA.  If there is one, stores it into *SECTOR and returns
+   true.  Candidates are compared byte for byte, so checksum
+   collisions are harmless.  Callers hold free_map_lock, under
+   which indexed sectors are forgotten, so the sector found stays
+   indexed and unchanged until they release it. */
+bool
+dedup_find (const void *data, block_sector_t *sector)
+{
+  struct dedup_entry key;
+  struct hash_elem *e;
+  uint8_t *contents;
+  bool found;
+
+  if (!enabled)
+    return false;
+  key.crc = crc32c (0, data, BLOCK_SECTOR_SIZE);
+  lock_acquire (&dedup_lock);
+  e = hash_find (&by_crc, &key.crc_elem);
+  if (e != NULL)
+    *sector = hash_entry (e, struct dedup_entry, crc_elem)->sector;
+  lock_release (&dedup_lock);
+  if (e == NULL)
+    return false;
+
+  contents = malloc (BLOCK_SECTOR_SIZE);
+  if (contents == NULL)
+    return false;
+  buffer_cache_read (*sector, contents);
+  found = !memcmp (contents, data, BLOCK_SECTOR_SIZE);
+  free (contents);
+  return found;
+}
+
+/* Records that SECTOR holds the BLOCK_SECTOR_SIZE bytes in DATA. */
+void
+dedup_add (block_sector_t sector, const void *data)
+{
+  struct dedup_entry *entry;
+
+  if (!enabled || entry_cnt >= DEDUP_MAX)
+    return;
+  entry = malloc (sizeof *entry);
+  if (entry == NULL)
+    return;
+  entry->crc = crc32c (0, data, BLOCK_SECTOR_SIZE);
+  entry->sector = sector;
+
+  lock_acquire (&dedup_lock);
+  if (hash_find (&by_sector, &entry->sector_elem) == NULL
+      && hash_insert (&by_crc, &entry->crc_elem) == NULL)
+    {
+      hash_insert (&by_sector, &entry->sector_elem);
+      entry_cnt++;
+      entry = NULL;
+    }
+  lock_release (&dedup_lock);
+  free (entry);
+}
+
+/* Drops SECTOR from the index, because its contents are about to
+   change or it is being freed. */
+void
+dedup_forget (block_sector_t sector)
+{
+  struct dedup_entry key, *entry = NULL;
+  struct hash_elem *e;
+
+  if (!enabled)
+    return;
+  key.sector = sector;
+  lock_acquire (&dedup_lock);
+  e = hash_delete (&by_sector, &key.sector_elem);
+  if (e != NULL)
+    {
+      entry = hash_entry (e, struct dedup_entry, sector_elem);
+      hash_delete (&by_crc, &entry->crc_elem);
+      entry_cnt--;
+    }
+  lock_release (&dedup_lock);
+  free (entry);
+}
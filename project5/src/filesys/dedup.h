@@ -0,0 +1,16 @@
+#ifndef FILESYS_DEDUP_H
+#define FILESYS_DEDUP_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Index of data sectors by content, used to store identical
+   sectors once.  Sharing itself is counted in the free map. */
+void dedup_init (void);
+void dedup_enable (void);
+bool dedup_enabled (void);
+bool dedup_find (const void *data, block_sector_t *sector);
+void dedup_add (block_sector_t sector, const void *data);
+void dedup_forget (block_sector_t sector);
+
+#endif /* filesys/dedup.h */
@@ -3,17 +3,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <round.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
-/* A directory. */
-struct dir
-  {
-    struct inode *inode;                /* Backing store. */
-    off_t pos;                          /* Current position. */
-  };
-
 /* A single directory entry. */
 struct dir_entry
   {
@@ -22,13 +16,35 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Entries never straddle sectors, which leaves the tail of each
+   sector free for its checksum. */
+#define ENTRIES_PER_SECTOR (CKSUM_OFS / sizeof (struct dir_entry))
+
+/* Returns the offset of the entry that follows the one at OFS. */
+static off_t
+next_entry (off_t ofs)
+{
+  ofs += sizeof (struct dir_entry);
+  if (ofs % BLOCK_SECTOR_SIZE + sizeof (struct dir_entry) > CKSUM_OFS)
+    ofs = ROUND_UP (ofs, BLOCK_SECTOR_SIZE);
+  return ofs;
+}
+
+/* Returns the number of bytes that ENTRY_CNT entries occupy. */
+static off_t
+entries_size (size_t entry_cnt)
+{
+  return (entry_cnt / ENTRIES_PER_SECTOR * BLOCK_SECTOR_SIZE
+          + entry_cnt % ENTRIES_PER_SECTOR * sizeof (struct dir_entry));
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the given SECTOR.
    Returns true if successful, false on failure. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
   bool res = true;
-  if((inode_create (sector, entry_cnt * sizeof (struct dir_entry),true)) == false)
+  if((inode_create (sector, entries_size (entry_cnt),true)) == false)
 	return false;
   // The first (offset 0) dir entry is for parent directory; do self-referencing
   // Actual parent directory will be set on execution of dir_add()
@@ -116,7 +132,7 @@ lookup (const struct dir *dir, const char *name,
 
   for (ofs = sizeof e; /* 0 is for parent directory */
        inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e)
+       ofs = next_entry (ofs))
     if (e.in_use && !strcmp (name, e.name))
       {
         if (ep != NULL)
@@ -127,68 +143,101 @@ lookup (const struct dir *dir, const char *name,
       }
   return false;
 }
-struct dir *make_path (const char *path){
-  int len = strlen(path) + 1;
-  char temp[len],*chunk,*pos;
-  strlcpy(temp, path,len);
-  struct inode *id;
-  struct thread *tcur = thread_current();
-  struct dir *dcur,*dnext;
-  if(path[0] != '/') { // relat 
-    if (tcur->cwd == NULL) // for non-process(main)
-      dcur = dir_open_root();
-    else 
-      dcur = dir_reopen(tcur->cwd);
-  }
-  else // abs
-    dcur = dir_open_root();
-  chunk = strtok_r(temp,"/",&pos);
-  while(chunk != NULL){
-    id = NULL;
-    if(dir_lookup(dcur, chunk, &id) == false) {
-      dir_close(dcur);
-      return NULL; 
+/* Descends from directory INODE into its entry NAME, which must be
+   an existing directory that has not been removed.  Releases INODE
+   either way, so a walk never holds more than one directory open.
+   Returns the child's inode, or a null pointer on failure. */
+static struct inode *
+walk_step (struct inode *inode, const char *name)
+{
+  struct dir dir = { inode, 0 };
+  struct inode *next;
+
+  dir_lookup (&dir, name, &next);
+  inode_close (inode);
+  if (next != NULL && (!is_inode_dir (next) || is_inode_rm (next)))
+    {
+      inode_close (next);
+      next = NULL;
     }
-    dnext = dir_open(id);
-    if(dnext == NULL) {
-      dir_close(dcur);
-      return NULL;
+  return next;
+}
+
+/* Walks PATH in place, one component at a time, starting from the
+   root for an absolute path and from the current thread's working
+   directory otherwise.  Nothing is copied or allocated besides the
+   final component.
+
+   On success returns true, stores the directory containing the
+   final component into *PARENT and that component into NAME, which
+   is empty if PATH has no components (e.g. "/").  The caller must
+   release PARENT->inode with inode_close().  Returns false if an
+   intermediate component is missing, is not a directory or is too
+   long, or if the parent directory has been removed. */
+bool
+dir_walk (const char *path, struct dir *parent, char name[NAME_MAX + 1])
+{
+  struct thread *tcur = thread_current ();
+  struct inode *inode;
+  const char *end;
+  size_t len;
+
+  if (path[0] == '/' || tcur->cwd == NULL) // abs, or non-process(main)
+    inode = inode_open (ROOT_DIR_SECTOR);
+  else
+    inode = inode_reopen (dir_get_inode (tcur->cwd));
+  name[0] = '\0';
+
+  while (inode != NULL)
+    {
+      while (*path == '/')
+        path++;
+      if (*path == '\0')
+        break;
+      for (end = path; *end != '\0' && *end != '/'; end++)
+        continue;
+      len = end - path;
+      if (len > NAME_MAX)
+        {
+          inode_close (inode);
+          return false;
+        }
+
+      /* A component followed by another one names a directory. */
+      if (name[0] != '\0')
+        inode = walk_step (inode, name);
+      memcpy (name, path, len);
+      name[len] = '\0';
+      path = end;
     }
-    dir_close(dcur);
-    dcur = dnext;
-    chunk = strtok_r(NULL, "/", &pos);
-  }
 
-  if (is_inode_rm(dir_get_inode(dcur))) {
-    dir_close(dcur);
-    return NULL;
-  }
-  return dcur;
-}
-void divide_fn(const char *path,char *d_token, char *f_token){
-  int last_len,len = strlen(path) + 1;
-  char *pos,*last="",*chunk,temp[len];
-  memcpy (temp, path, sizeof(char)*len);
-  char *d_temp = d_token;
-  if(len!= 0 && path[0] == '/') 
-    if(strlen(d_temp)) 
-	*d_temp++ = '/';
-  chunk = strtok_r(temp,"/",&pos);
-  while(chunk != NULL){
-    last_len = strlen (last);
-    if (d_temp && last_len!= 0) {
-      memcpy (d_temp, last, sizeof(char) * last_len);
-      d_temp[last_len] = '/';
-      d_temp += last_len;
-      d_temp++;
+  if (inode == NULL)
+    return false;
+  if (is_inode_rm (inode))
+    {
+      inode_close (inode);
+      return false;
     }
-    last = chunk;
-    chunk = strtok_r(NULL, "/", &pos);
-  }
+  parent->inode = inode;
+  parent->pos = sizeof (struct dir_entry);
+  return true;
+}
+
+/* Opens and returns the directory named by PATH.
+   Returns a null pointer if PATH does not name a directory. */
+struct dir *
+make_path (const char *path)
+{
+  struct dir parent;
+  char name[NAME_MAX + 1];
+  struct inode *inode;
 
-  if(d_temp) 
-	*d_temp = '\0';
-  memcpy (f_token, last, sizeof(char) * (strlen(last) + 1));
+  if (!dir_walk (path, &parent, name))
+    return NULL;
+  if (name[0] == '\0')
+    return dir_open (parent.inode);
+  inode = walk_step (parent.inode, name);
+  return inode != NULL ? dir_open (inode) : NULL;
 }
 
 bool
@@ -198,7 +247,7 @@ dir_empty (const struct dir *dir)
   size_t ofs;
   ASSERT(dir != NULL);
 
-  for (ofs = sizeof e;inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;ofs += sizeof e){
+  for (ofs = sizeof e;inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;ofs = next_entry (ofs)){
     if (e.in_use) // not empty
       return false;
   }
@@ -285,7 +334,7 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector, bool is
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e)
+       ofs = next_entry (ofs))
     if (!e.in_use)
       break;
 
@@ -346,22 +395,181 @@ dir_remove (struct dir *dir, const char *name)
   return success;
 }
 
+/* Returns true if NAME may name a directory entry. */
+static bool
+name_is_valid (const char *name)
+{
+  return *name != '\0' && strlen (name) <= NAME_MAX
+         && strcmp (name, ".") && strcmp (name, "..");
+}
+
+/* Returns true if the directory in SECTOR is DIR or one of DIR's
+   ancestors, following the parent entries at offset 0 up to the
+   root. */
+static bool
+is_ancestor (block_sector_t sector, const struct dir *dir)
+{
+  struct inode *inode = inode_reopen (dir->inode);
+  struct dir_entry e;
+  bool found = false;
+
+  while (inode != NULL)
+    {
+      block_sector_t cur = inode_get_inumber (inode);
+      if (cur == sector)
+        {
+          found = true;
+          break;
+        }
+      if (cur == ROOT_DIR_SECTOR
+          || inode_read_at (inode, &e, sizeof e, 0) != sizeof e
+          || e.inode_sector == cur)
+        break;
+      inode_close (inode);
+      inode = inode_open (e.inode_sector);
+    }
+  inode_close (inode);
+  return found;
+}
+
+/* Moves the entry OLD_NAME in OLD_DIR to NEW_NAME in NEW_DIR,
+   which may be the same directory.  An existing regular file
+   named NEW_NAME is replaced and removed.  A moved directory has
+   its parent entry pointed at NEW_DIR.  The new entry is written
+   before the old one is erased, so the file is never unlinked,
+   and is undone if the erase fails, so a failed rename leaves
+   both directories as they were.
+
+   Returns true if successful, false on failure, which occurs if
+   OLD_NAME does not exist, either name is invalid, NEW_NAME is a
+   directory, or a directory would be moved into itself. */
+bool
+dir_rename (struct dir *old_dir, const char *old_name,
+            struct dir *new_dir, const char *new_name)
+{
+  struct dir_entry e, ne;
+  struct inode *inode = NULL, *victim = NULL;
+  off_t ofs, nofs;
+  bool is_dir, success = false;
+
+  ASSERT (old_dir != NULL);
+  ASSERT (new_dir != NULL);
+
+  if (!name_is_valid (old_name) || !name_is_valid (new_name))
+    return false;
+
+  /* Find directory entry. */
+  if (!lookup (old_dir, old_name, &e, &ofs))
+    return false;
+  inode = inode_open (e.inode_sector);
+  if (inode == NULL)
+    return false;
+  is_dir = is_inode_dir (inode);
+
+  /* A directory can't become its own descendant. */
+  if (is_dir && is_ancestor (e.inode_sector, new_dir))
+    goto done;
+
+  if (lookup (new_dir, new_name, &ne, &nofs))
+    {
+      /* Renaming a file onto itself is a no-op. */
+      if (ne.inode_sector == e.inode_sector)
+        {
+          success = true;
+          goto done;
+        }
+      victim = inode_open (ne.inode_sector);
+      if (is_dir || victim == NULL || is_inode_dir (victim))
+        goto done;
+
+      /* Point the existing entry at the moved file. */
+      ne.inode_sector = e.inode_sector;
+      if (inode_write_at (new_dir->inode, &ne, sizeof ne, nofs) != sizeof ne)
+        goto done;
+    }
+  else if (!dir_add (new_dir, new_name, e.inode_sector, is_dir))
+    goto done;
+
+  /* Erase the old entry.  dir_add() only fills free slots, so OFS
+     still holds it. */
+  e.in_use = false;
+  if (inode_write_at (old_dir->inode, &e, sizeof e, ofs) != sizeof e)
+    {
+      if (victim != NULL)
+        {
+          ne.inode_sector = inode_get_inumber (victim);
+          inode_write_at (new_dir->inode, &ne, sizeof ne, nofs);
+        }
+      else if (lookup (new_dir, new_name, &ne, &nofs))
+        {
+          ne.in_use = false;
+          inode_write_at (new_dir->inode, &ne, sizeof ne, nofs);
+        }
+      goto done;
+    }
+
+  if (victim != NULL)
+    inode_remove (victim);
+  success = true;
+
+ done:
+  inode_close (victim);
+  inode_close (inode);
+  return success;
+}
+
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
    contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  block_sector_t sector;
+
+  return dir_read_entry (dir, name, &sector);
+}
+
+/* Like dir_readdir(), but also stores the entry's inode sector
+   into *SECTOR. */
+bool
+dir_read_entry (struct dir *dir, char name[NAME_MAX + 1],
+                block_sector_t *sector)
 {
   struct dir_entry e;
 
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e)
     {
-      dir->pos += sizeof e;
+      dir->pos = next_entry (dir->pos);
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
+          *sector = e.inode_sector;
           return true;
         }
     }
   return false;
 }
+
+/* Returns the inode sector that DIR's parent entry, at offset 0,
+   points to. */
+block_sector_t
+dir_get_parent (struct dir *dir)
+{
+  struct dir_entry e;
+
+  if (inode_read_at (dir->inode, &e, sizeof e, 0) != sizeof e)
+    return ROOT_DIR_SECTOR;
+  return e.inode_sector;
+}
+
+/* Points DIR's parent entry at the directory in SECTOR.
+   Returns true if successful, false on failure. */
+bool
+dir_set_parent (struct dir *dir, block_sector_t sector)
+{
+  struct dir_entry e;
+
+  memset (&e, 0, sizeof e);
+  e.inode_sector = sector;
+  return inode_write_at (dir->inode, &e, sizeof e, 0) == sizeof e;
+}
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "devices/block.h"
+#include "filesys/off_t.h"
 
 /* Maximum length of a file name component.
    This is the traditional UNIX maximum length.
@@ -13,6 +14,14 @@
 
 struct inode;
 
+/* A directory.
+   Exposed so that path walking can hand a parent directory back
+   to its caller on the stack instead of allocating one. */
+struct dir
+  {
+    struct inode *inode;                /* Backing store. */
+    off_t pos;                          /* Current position. */
+  };
 
 /* Opening and closing directories. */
 bool dir_create (block_sector_t sector, size_t entry_cnt);
@@ -21,7 +30,7 @@ struct dir *dir_open_root (void);
 struct dir *dir_reopen (struct dir *);
 void dir_close (struct dir *);
 struct inode *dir_get_inode (struct dir *);
-void divide_fn(const char *path, char *d_token, char *f_token);
+bool dir_walk (const char *path, struct dir *parent, char name[NAME_MAX + 1]);
 struct dir* make_path (const char *);
 bool dir_empty (const struct dir *);
 
@@ -29,6 +38,12 @@ bool dir_empty (const struct dir *);
 bool dir_lookup (const struct dir *, const char *name, struct inode **);
 bool dir_add (struct dir *, const char *name, block_sector_t, bool is_dir);
 bool dir_remove (struct dir *, const char *name);
+bool dir_rename (struct dir *, const char *old_name,
+                 struct dir *, const char *new_name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+bool dir_read_entry (struct dir *, char name[NAME_MAX + 1],
+                     block_sector_t *);
+block_sector_t dir_get_parent (struct dir *);
+bool dir_set_parent (struct dir *, block_sector_t);
 
 #endif /* filesys/directory.h */
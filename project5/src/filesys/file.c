@@ -2,6 +2,7 @@
 #include <debug.h>
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* An open file. */
 struct file
@@ -9,6 +10,7 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    struct lock pos_lock;       /* See file_lock(). */
   };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -23,6 +25,7 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      lock_init (&file->pos_lock);
       return file;
     }
   else
@@ -113,6 +116,28 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Grows FILE to LENGTH bytes if it is shorter, so that a series
+   of writes up to LENGTH extends the file only once.  Returns
+   false if the file could not be grown. */
+bool
+file_extend (struct file *file, off_t length)
+{
+  return inode_extend (file->inode, length);
+}
+
+/* Copies SIZE bytes from SRC into DST inside the kernel, each
+   starting at its file's current position, and advances both
+   positions by the number of bytes copied, which is returned. */
+off_t
+file_copy (struct file *dst, struct file *src, off_t size)
+{
+  off_t bytes_copied = inode_copy (dst->inode, dst->pos,
+                                   src->inode, src->pos, size);
+  dst->pos += bytes_copied;
+  src->pos += bytes_copied;
+  return bytes_copied;
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
@@ -158,6 +183,23 @@ file_seek (struct file *file, off_t new_pos)
   file->pos = new_pos;
 }
 
+/* Acquires FILE's position lock.  Callers that share FILE
+   between threads hold it across a read, write, seek or series of
+   them, so that transfers at the file position don't interleave;
+   the file system below does its own locking. */
+void
+file_lock (struct file *file)
+{
+  lock_acquire (&file->pos_lock);
+}
+
+/* Releases FILE's position lock. */
+void
+file_unlock (struct file *file)
+{
+  lock_release (&file->pos_lock);
+}
+
 /* Returns the current position in FILE as a byte offset from the
    start of the file. */
 off_t
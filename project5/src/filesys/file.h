@@ -1,6 +1,7 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <stdbool.h>
 #include "filesys/off_t.h"
 
 struct inode;
@@ -16,6 +17,8 @@ off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+bool file_extend (struct file *, off_t length);
+off_t file_copy (struct file *dst, struct file *src, off_t size);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
@@ -25,5 +28,7 @@ void file_allow_write (struct file *);
 void file_seek (struct file *, off_t);
 off_t file_tell (struct file *);
 off_t file_length (struct file *);
+void file_lock (struct file *);
+void file_unlock (struct file *);
 
 #endif /* filesys/file.h */
@@ -8,16 +8,20 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/dedup.h"
+#include "filesys/journal.h"
+#include "filesys/snapshot.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
-static void do_format (void);
+static void do_format (unsigned features);
 
 /* Initializes the file system module.
-   If FORMAT is true, reformats the file system. */
+   If FORMAT is true, reformats the file system with the FS_*
+   FEATURES given. */
 void
-filesys_init (bool format)
+filesys_init (bool format, unsigned features)
 {
   fs_device = block_get_role (BLOCK_FILESYS);
   if (fs_device == NULL)
@@ -26,10 +30,22 @@ filesys_init (bool format)
   buffer_cache_init ();
   inode_init ();
   free_map_init ();
+  journal_init ();
+  snapshot_init ();
+  dedup_init ();
   if (format)
-    do_format ();
+    do_format (features);
 
+  journal_recover ();
+  features = journal_features ();
+  buffer_cache_set_cksum (features & FS_CKSUM);
+  inode_set_block_size (FS_BLOCK_SECTORS (features));
   free_map_open ();
+  if (features & FS_DEDUP)
+    {
+      free_map_open_refs ();
+      dedup_enable ();
+    }
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -37,6 +53,8 @@ filesys_init (bool format)
 void
 filesys_done (void)
 {
+  inode_reap ();
+  snapshot_drop ();
   free_map_close ();
   buffer_cache_terminate ();
 }
@@ -47,23 +65,42 @@ filesys_done (void)
 
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
-   or if internal memory allocation fails. */
+   or if internal memory allocation fails.
+   The file is created empty in one journal operation and then
+   grown to `initial_size` in as many as that takes; if the disk
+   fills up on the way, it is removed again. */
 bool
 filesys_create (const char *path, off_t initial_size, bool is_dir)
 {
   block_sector_t inode_sector = 0;
-  int len = strlen(path);
-  char f_token[len],d_token[len];
-  divide_fn(path, d_token, f_token);
-  struct dir *dir = make_path (d_token);
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size, is_dir)
-                  && dir_add (dir, f_token, inode_sector, is_dir));
+  char name[NAME_MAX + 1];
+  struct inode *inode;
+  struct dir dir;
+  if (!dir_walk (path, &dir, name))
+    return false;
+  journal_begin ();
+  bool success = (free_map_allocate (1, &inode_sector)
+                  && inode_create (inode_sector, 0, is_dir)
+                  && dir_add (&dir, name, inode_sector, is_dir));
 
   if (!success && inode_sector != 0)
     free_map_release (inode_sector, 1);
-  dir_close (dir);
+  journal_end ();
+
+  if (success && initial_size > 0)
+    {
+      inode = inode_open (inode_sector);
+      success = inode != NULL && inode_extend (inode, initial_size);
+      inode_close (inode);
+      if (!success)
+        {
+          journal_begin ();
+          dir_remove (&dir, name);
+          journal_end ();
+          inode_reap ();
+        }
+    }
+  inode_close (dir.inode);
 
   return success;
 }
@@ -76,25 +113,25 @@ filesys_create (const char *path, off_t initial_size, bool is_dir)
 struct file *
 filesys_open (const char *name)
 {
-  int len = strlen(name);
-  if (++len == 1) 
-	 return NULL;
-  char f_token[len],d_token[len];
-  divide_fn(name, d_token, f_token);
-  struct dir *dir = make_path (d_token);
-  if (dir == NULL) 
-	  return NULL;
+  char leaf[NAME_MAX + 1];
+  struct dir dir;
+  if (name[0] == '\0')
+    return NULL;
+  if (!dir_walk (name, &dir, leaf))
+    return NULL;
   struct inode *inode = NULL;
-  if (strlen(f_token)) {
-    dir_lookup (dir, f_token, &inode);
-    dir_close (dir);
+  if (leaf[0] != '\0') {
+    dir_lookup (&dir, leaf, &inode);
+    inode_close (dir.inode);
   }
   else 
-    inode = dir_get_inode (dir);
+    inode = dir.inode;
   if (inode == NULL)
 	return NULL;	  
-  if(is_inode_rm(inode))
+  if(is_inode_rm(inode)) {
+	inode_close (inode);
 	return NULL;
+  }
   return file_open (inode);
 }
 
@@ -105,15 +142,45 @@ filesys_open (const char *name)
 bool
 filesys_remove (const char *name)
 {
-  int len = strlen(name);
-  if (++len == 1) 
-	 return NULL;
-  char f_token[len],d_token[len];
-  divide_fn(name, d_token, f_token);
-  struct dir *dir = make_path (d_token);
-
-  bool success = dir != NULL && dir_remove (dir, f_token);
-  dir_close (dir);
+  char leaf[NAME_MAX + 1];
+  struct dir dir;
+  if (name[0] == '\0')
+    return false;
+  if (!dir_walk (name, &dir, leaf))
+    return false;
+
+  journal_begin ();
+  bool success = dir_remove (&dir, leaf);
+  inode_close (dir.inode);
+  journal_end ();
+  inode_reap ();
+  return success;
+}
+
+/* Moves the file or directory OLD to NEW, replacing NEW if it is
+   an existing file.  Only directory entries change; no file data
+   is copied.
+   Returns true if successful, false on failure. */
+bool
+filesys_rename (const char *old, const char *new)
+{
+  char old_name[NAME_MAX + 1], new_name[NAME_MAX + 1];
+  struct dir old_dir, new_dir;
+  bool success;
+
+  if (!dir_walk (old, &old_dir, old_name))
+    return false;
+  if (!dir_walk (new, &new_dir, new_name))
+    {
+      inode_close (old_dir.inode);
+      return false;
+    }
+  journal_begin ();
+  success = dir_rename (&old_dir, old_name, &new_dir, new_name);
+  inode_close (new_dir.inode);
+  inode_close (old_dir.inode);
+  journal_end ();
+  inode_reap ();
   return success;
 }
 
@@ -132,10 +199,20 @@ filesys_chdir (const char *name)
 
 /* Formats the file system. */
 static void
-do_format (void)
+do_format (unsigned features)
 {
   printf ("Formatting file system...");
+  if ((features & FS_DEDUP) && FS_BLOCK_SECTORS (features) > 1)
+    {
+      printf ("deduplication needs 512-byte blocks, disabled...");
+      features &= ~FS_DEDUP;
+    }
+  buffer_cache_set_cksum (features & FS_CKSUM);
+  inode_set_block_size (FS_BLOCK_SECTORS (features));
   free_map_create ();
+  if (features & FS_DEDUP)
+    free_map_create_refs ();
+  journal_format (features);
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
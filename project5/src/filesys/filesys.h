@@ -7,15 +7,29 @@
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* Metadata journal header sector. */
+#define REFCOUNT_SECTOR 51      /* Shared sector counts file inode sector. */
+
+/* File system features chosen at format time. */
+#define FS_CKSUM 0x1            /* Metadata is checksummed. */
+#define FS_DEDUP 0x2            /* Identical data sectors are shared. */
+#define FS_BLOCK_SHIFT 8        /* Higher bits: log2 of sectors per block. */
+#define FS_BLOCK_SECTORS(FEATURES) (1u << ((FEATURES) >> FS_BLOCK_SHIFT))
+
+/* Checksummed metadata sectors (inodes, indirect blocks and
+   directory contents) keep the CRC-32C of their first CKSUM_OFS
+   bytes in their last four. */
+#define CKSUM_OFS (BLOCK_SECTOR_SIZE - 4)
 
 /* Block device that contains the file system. */
 struct block *fs_device;
 
-void filesys_init (bool format);
+void filesys_init (bool format, unsigned features);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size, bool is_dir);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
 bool filesys_chdir (const char *name);
+bool filesys_rename (const char *old, const char *new);
 
 #endif /* filesys/filesys.h */
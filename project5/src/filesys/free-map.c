@@ -1,12 +1,29 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "filesys/dedup.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Free map bits in one sector of the free map file. */
+#define BLOCK_SECTOR_BITS (BLOCK_SECTOR_SIZE * 8)
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct lock free_map_lock;    /* Guards the map file and REFS. */
+
+/* On a file system with deduplication, the number of extra
+   references to each sector, and the file that holds them.
+   A sector with extra references stays in use when released. */
+static struct file *refs_file;
+static uint8_t *refs;
 
 /* Initializes the free map. */
 void
@@ -17,6 +34,23 @@ free_map_init (void)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+  ASSERT (REFCOUNT_SECTOR == JOURNAL_SECTOR + JOURNAL_SECTORS);
+  bitmap_mark (free_map, REFCOUNT_SECTOR);
+  lock_init (&free_map_lock);
+}
+
+/* Takes CNT consecutive free sectors out of the free map and
+   returns the first, or BITMAP_ERROR.  Runs with interrupts off,
+   since free_map_reserve() is called from inside the buffer
+   cache and can't take FREE_MAP_LOCK. */
+static size_t
+take_sectors (size_t cnt)
+{
+  enum intr_level old_level = intr_disable ();
+  size_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  intr_set_level (old_level);
+  return sector;
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -27,26 +61,199 @@ free_map_init (void)
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = take_sectors (cnt);
   if (sector != BITMAP_ERROR
       && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+      && !bitmap_write_range (free_map, free_map_file, sector, cnt))
     {
       bitmap_set_multiple (free_map, sector, cnt, false);
       sector = BITMAP_ERROR;
     }
+  lock_release (&free_map_lock);
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Takes a free sector out of use in memory only and stores it
+   into *SECTORP, for callers that can't write the free map file
+   because they run inside the buffer cache.  The sector is given
+   back with free_map_release().  Returns true if successful. */
+bool
+free_map_reserve (block_sector_t *sectorp)
+{
+  block_sector_t sector = take_sectors (1);
+  if (sector == BITMAP_ERROR)
+    return false;
+  *sectorp = sector;
+  return true;
+}
+
+/* Writes the reference count of SECTOR to disk. */
+static bool
+write_ref (block_sector_t sector)
+{
+  return file_write_at (refs_file, &refs[sector], 1, sector) == 1;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use.  A
+   shared sector, released on its own, just loses a reference. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  size_t i;
+
   ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  lock_acquire (&free_map_lock);
+  if (cnt == 1 && free_map_shared (sector))
+    {
+      refs[sector]--;
+      write_ref (sector);
+    }
+  else
+    {
+      for (i = 0; i < cnt; i++)
+        dedup_forget (sector + i);
+      bitmap_set_multiple (free_map, sector, cnt, false);
+      bitmap_write_range (free_map, free_map_file, sector, cnt);
+    }
+  lock_release (&free_map_lock);
+}
+
+/* Adds a reference to SECTOR, with free_map_lock held.  Returns
+   false if SECTOR is not in use, sectors are not shared on this
+   file system or SECTOR has as many references as can be
+   counted. */
+static bool
+share_locked (block_sector_t sector)
+{
+  bool success = false;
+
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+  if (refs != NULL && bitmap_test (free_map, sector)
+      && refs[sector] < UINT8_MAX)
+    {
+      refs[sector]++;
+      success = write_ref (sector);
+      if (!success)
+        refs[sector]--;
+    }
+  return success;
+}
+
+/* Adds a reference to SECTOR, which should be in use, so that it
+   is freed only once every user has released it.  Returns false
+   if SECTOR can't be shared; see share_locked(). */
+bool
+free_map_share (block_sector_t sector)
+{
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = share_locked (sector);
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Looks for an indexed sector holding the BLOCK_SECTOR_SIZE bytes
+   in DATA and, unless it is OWN, the sector the caller already
+   keeps them in (or 0), adds a reference to it.  Lookup,
+   comparison and reference are one step under free_map_lock, so
+   the sector can be neither released nor rewritten in place by
+   its owner in between; see free_map_exclusive().  Stores the
+   sector into *SECTORP and returns true if successful. */
+bool
+free_map_share_data (const void *data, block_sector_t own,
+                     block_sector_t *sectorp)
+{
+  block_sector_t sector;
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = (dedup_find (data, &sector)
+             && (sector == own || share_locked (sector)));
+  lock_release (&free_map_lock);
+  if (success)
+    *sectorp = sector;
+  return success;
+}
+
+/* Prepares SECTOR, in use, to be overwritten in place.  Returns
+   false if it is shared, so that the caller must copy it
+   instead.  Otherwise drops it from the deduplication index in
+   the same step, so free_map_share_data() can no longer hand it
+   out, and returns true. */
+bool
+free_map_exclusive (block_sector_t sector)
+{
+  bool exclusive;
+
+  lock_acquire (&free_map_lock);
+  exclusive = !free_map_shared (sector);
+  if (exclusive)
+    dedup_forget (sector);
+  lock_release (&free_map_lock);
+  return exclusive;
+}
+
+/* Returns true if SECTOR has more than one user. */
+bool
+free_map_shared (block_sector_t sector)
+{
+  return refs != NULL && refs[sector] > 0;
+}
+
+/* Compares the free map with USED, the set of sectors found in
+   use by walking the file system, and reports each sector on
+   which they disagree.  If REPAIR is true, replaces the free map
+   with USED.  Returns the number of mismatched sectors. */
+size_t
+free_map_check (const struct bitmap *used, bool repair)
+{
+  size_t leaked = 0, lost = 0;
+  size_t i, cnt = bitmap_size (free_map);
+
+  ASSERT (bitmap_size (used) == cnt);
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (free_map, i) != bitmap_test (used, i))
+      {
+        if (bitmap_test (used, i))
+          {
+            printf ("fsck: sector %zu is in use but marked free\n", i);
+            lost++;
+          }
+        else
+          leaked++;
+      }
+  if (leaked > 0)
+    printf ("fsck: %zu sectors are marked used but unreachable\n", leaked);
+
+  if (repair && leaked + lost > 0)
+    {
+      bitmap_set_all (free_map, false);
+      for (i = 0; i < cnt; i++)
+        if (bitmap_test (used, i))
+          bitmap_mark (free_map, i);
+      /* One free map sector per journal operation. */
+      for (i = 0; i < cnt; i += BLOCK_SECTOR_BITS)
+        {
+          size_t bits = (cnt - i < BLOCK_SECTOR_BITS
+                         ? cnt - i : BLOCK_SECTOR_BITS);
+          bool ok;
+          journal_begin ();
+          ok = bitmap_write_range (free_map, free_map_file, i, bits);
+          journal_end ();
+          if (!ok)
+            {
+              printf ("fsck: can't write free map\n");
+              break;
+            }
+        }
+    }
+  return leaked + lost;
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -60,11 +267,45 @@ free_map_open (void)
     PANIC ("can't read free map");
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Writes the free map to disk and closes the free map file and
+   the reference count file. */
 void
 free_map_close (void)
 {
   file_close (free_map_file);
+  file_close (refs_file);
+  refs_file = NULL;
+  free (refs);
+  refs = NULL;
+}
+
+/* Opens the reference count file of a file system with
+   deduplication and reads it from disk. */
+void
+free_map_open_refs (void)
+{
+  size_t cnt = bitmap_size (free_map);
+
+  refs = malloc (cnt);
+  refs_file = file_open (inode_open (REFCOUNT_SECTOR));
+  if (refs == NULL || refs_file == NULL)
+    PANIC ("can't open reference counts");
+  if (file_read_at (refs_file, refs, cnt, 0) != (off_t) cnt)
+    PANIC ("can't read reference counts");
+}
+
+/* Creates a new, all-zero reference count file on disk. */
+void
+free_map_create_refs (void)
+{
+  size_t cnt = bitmap_size (free_map);
+
+  if (!inode_create (REFCOUNT_SECTOR, cnt, false))
+    PANIC ("reference count file creation failed");
+  refs = calloc (cnt, 1);
+  refs_file = file_open (inode_open (REFCOUNT_SECTOR));
+  if (refs == NULL || refs_file == NULL)
+    PANIC ("can't open reference counts");
 }
 
 /* Creates a new free map file on disk and writes the free map to
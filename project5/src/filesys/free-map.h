@@ -10,8 +10,19 @@ void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
+void free_map_create_refs (void);
+void free_map_open_refs (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+bool free_map_reserve (block_sector_t *);
+bool free_map_share (block_sector_t);
+bool free_map_share_data (const void *, block_sector_t own,
+                          block_sector_t *);
+bool free_map_exclusive (block_sector_t);
+bool free_map_shared (block_sector_t);
+
+struct bitmap;
+size_t free_map_check (const struct bitmap *used, bool repair);
 
 #endif /* filesys/free-map.h */
@@ -4,9 +4,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ustar.h>
+#include <bitmap.h>
+#include "filesys/dedup.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -221,3 +226,193 @@ fsutil_append (char **argv)
   file_close (src);
   free (buffer);
 }
+
+/* Points DIR's parent entry at the directory in PARENT, as one
+   journal operation of its own, as free_map_check() does for each
+   free map sector it repairs. */
+static void
+repair_parent (struct dir *dir, block_sector_t parent)
+{
+  journal_begin ();
+  dir_set_parent (dir, parent);
+  journal_end ();
+}
+
+/* Checks the consistency of the file system.  Walks every inode
+   reachable from the root directory through its direct blocks
+   and its indirect blocks at every level, checks that each
+   directory's parent entry points at the directory it was found
+   in, and compares the set of sectors found in use against the
+   free map.
+
+   Invoked as "fsck-repair", also fixes wrong parent entries and
+   rewrites the free map, which releases leaked sectors.  Entries
+   that point at damaged inodes are only reported. */
+void
+fsutil_fsck (char **argv)
+{
+  bool repair = !strcmp (argv[0], "fsck-repair");
+  struct bitmap *used;
+  block_sector_t *pending;      /* Directories left to scan. */
+  size_t pending_cnt = 0, pending_max = 64;
+  size_t errors = 0, dir_cnt = 0, file_cnt = 0;
+  bool is_dir;
+
+  printf ("Checking file system...\n");
+  used = bitmap_create (block_size (fs_device));
+  pending = malloc (pending_max * sizeof *pending);
+  if (used == NULL || pending == NULL)
+    PANIC ("couldn't allocate fsck buffers");
+
+  /* System areas. */
+  if (journal_enabled ())
+    bitmap_set_multiple (used, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+  bitmap_mark (used, FREE_MAP_SECTOR);
+  inode_check (FREE_MAP_SECTOR, used, &is_dir, &errors);
+  bitmap_mark (used, REFCOUNT_SECTOR);
+  if (journal_features () & FS_DEDUP)
+    inode_check (REFCOUNT_SECTOR, used, &is_dir, &errors);
+  bitmap_mark (used, ROOT_DIR_SECTOR);
+  if (!inode_check (ROOT_DIR_SECTOR, used, &is_dir, &errors) || !is_dir)
+    PANIC ("fsck: root directory is damaged");
+  pending[pending_cnt++] = ROOT_DIR_SECTOR;
+
+  /* Walk the tree without recursion, so deep trees can't
+     overflow the kernel stack. */
+  while (pending_cnt > 0)
+    {
+      block_sector_t parent = pending[--pending_cnt];
+      struct dir *dir = dir_open (inode_open (parent));
+      char name[NAME_MAX + 1];
+      block_sector_t sector;
+
+      if (dir == NULL)
+        PANIC ("couldn't open directory %"PRDSNu, parent);
+      dir_cnt++;
+      if (parent == ROOT_DIR_SECTOR && dir_get_parent (dir) != parent)
+        {
+          printf ("fsck: root directory has a wrong parent entry\n");
+          errors++;
+          if (repair)
+            repair_parent (dir, parent);
+        }
+
+      while (dir_read_entry (dir, name, &sector))
+        {
+          struct dir *child;
+
+          if (sector >= bitmap_size (used) || bitmap_test (used, sector))
+            {
+              printf ("fsck: \"%s\" in directory %"PRDSNu": inode %"PRDSNu
+                      " is invalid or linked twice\n", name, parent, sector);
+              errors++;
+              continue;
+            }
+          bitmap_mark (used, sector);
+          if (!inode_check (sector, used, &is_dir, &errors))
+            continue;
+          if (!is_dir)
+            {
+              file_cnt++;
+              continue;
+            }
+
+          child = dir_open (inode_open (sector));
+          if (child == NULL)
+            PANIC ("couldn't open directory %"PRDSNu, sector);
+          if (dir_get_parent (child) != parent)
+            {
+              printf ("fsck: directory \"%s\" (%"PRDSNu") has parent entry "
+                      "%"PRDSNu", expected %"PRDSNu"\n",
+                      name, sector, dir_get_parent (child), parent);
+              errors++;
+              if (repair)
+                repair_parent (child, parent);
+            }
+          dir_close (child);
+
+          if (pending_cnt == pending_max)
+            {
+              block_sector_t *p = realloc (pending,
+                                           2 * pending_max * sizeof *p);
+              if (p == NULL)
+                PANIC ("couldn't allocate fsck buffers");
+              pending = p;
+              pending_max *= 2;
+            }
+          pending[pending_cnt++] = sector;
+        }
+      dir_close (dir);
+    }
+
+  errors += free_map_check (used, repair);
+  printf ("fsck: %zu directories, %zu files, %zu problems%s\n",
+          dir_cnt, file_cnt, errors,
+          repair && errors > 0 ? " (repaired where possible)" : "");
+
+  free (pending);
+  bitmap_destroy (used);
+}
+
+/* Shares identical data sectors among all the regular files on a
+   file system formatted with deduplication, which catches files
+   written before their twins were indexed, such as on an earlier
+   boot. */
+void
+fsutil_dedup (char **argv UNUSED)
+{
+  block_sector_t *pending;      /* Directories left to scan. */
+  size_t pending_cnt = 0, pending_max = 64;
+  size_t file_cnt = 0, freed = 0;
+
+  if (!dedup_enabled ())
+    {
+      printf ("dedup: file system was not formatted with -dedup\n");
+      return;
+    }
+  printf ("Deduplicating file system...\n");
+  pending = malloc (pending_max * sizeof *pending);
+  if (pending == NULL)
+    PANIC ("couldn't allocate dedup buffers");
+  pending[pending_cnt++] = ROOT_DIR_SECTOR;
+
+  while (pending_cnt > 0)
+    {
+      struct dir *dir = dir_open (inode_open (pending[--pending_cnt]));
+      char name[NAME_MAX + 1];
+      block_sector_t sector;
+
+      if (dir == NULL)
+        continue;
+      while (dir_read_entry (dir, name, &sector))
+        {
+          struct inode *inode = inode_open (sector);
+
+          if (inode == NULL)
+            continue;
+          if (!is_inode_dir (inode))
+            {
+              freed += inode_dedup (inode);
+              file_cnt++;
+            }
+          else
+            {
+              if (pending_cnt == pending_max)
+                {
+                  block_sector_t *p = realloc (pending,
+                                               2 * pending_max * sizeof *p);
+                  if (p == NULL)
+                    PANIC ("couldn't allocate dedup buffers");
+                  pending = p;
+                  pending_max *= 2;
+                }
+              pending[pending_cnt++] = sector;
+            }
+          inode_close (inode);
+        }
+      dir_close (dir);
+    }
+
+  printf ("dedup: %zu files, %zu sectors freed\n", file_cnt, freed);
+  free (pending);
+}
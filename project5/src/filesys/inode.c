@@ -1,30 +1,55 @@
 #include "filesys/inode.h"
 #include <list.h>
+#include <bitmap.h>
 #include <debug.h>
+#include <lz.h>
 #include <round.h>
+#include <stdio.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "filesys/cache.h"
+#include "filesys/dedup.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Compressed files are read and written in clusters of
+   CLUSTER_SECTORS sectors.  A cluster is stored in the first few
+   of its block map entries, the rest being 0: none for a cluster
+   of zeros, all of them for one that does not compress, and
+   otherwise a 2-byte compressed length followed by the
+   compressed data. */
+#define CLUSTER_SECTORS 8
+#define CLUSTER_SIZE (CLUSTER_SECTORS * BLOCK_SECTOR_SIZE)
+
+/* Journal operations are kept within JOURNAL_OP_MAX sectors by
+   growing files EXTEND_BLOCKS data blocks at a time and deleting
+   them DELETE_BATCH blocks at a time. */
+#define EXTEND_BLOCKS 128
+#define DELETE_BATCH 5
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
-    block_sector_t d_indir_block;
-    block_sector_t indir_block;
+    block_sector_t indir_blocks[INDIR_LEVELS]; /* Singly, doubly and
+                                                   triply indirect. */
     block_sector_t dir_blocks[DIRECT];
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
     bool is_dir;
+    bool compressed;                    /* Data in compressed clusters? */
+    uint32_t cksum;                     /* See CKSUM_OFS in cache.h. */
   };
 
 struct indir_inode {
   block_sector_t block[INDIRECT];
+  uint32_t cksum;
 };
 
 /* In-memory inode. */
@@ -35,13 +60,47 @@ struct inode
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct lock lock;                   /* Guards growth and block map. */
+    struct lock sector_lock;            /* Serializes sector writes. */
+    unsigned gen;                       /* See inode_generation(). */
     struct inode_disk data;             /* Inode content. */
+
+    /* Compressed files only. */
+    struct lock cluster_lock;           /* Guards the members below. */
+    uint8_t *cluster;                   /* Decompressed cluster or null. */
+    off_t cluster_idx;                  /* Cluster held, or -1 if none. */
   };
 
+/* Source of inode generations.  Never reused, so a generation
+   names one state of one open inode. */
+static unsigned next_gen;
+
+/* Returns a generation no inode has had yet. */
+static unsigned
+new_gen (void)
+{
+  enum intr_level old_level = intr_disable ();
+  unsigned gen = ++next_gen;
+  intr_set_level (old_level);
+  return gen;
+}
+
 bool inode_reserve (struct inode_disk *page, int len);
 bool inode_delete (struct inode *id);
 bool inode_new (struct inode_disk *page);
 block_sector_t sector_number(struct inode_disk *idisk, off_t index);
+static void set_sector_number (struct inode *, size_t index,
+                               block_sector_t sector);
+
+/* File data is allocated in blocks of this many contiguous
+   sectors, chosen when the file system is formatted.  The block
+   map points at the first sector of each block.  Inodes and
+   indirect blocks always take a single sector. */
+static unsigned block_sectors = 1;
+
+/* Returned by sector_number() when the block map can't be read. */
+#define SECTOR_NONE ((block_sector_t) -1)
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
@@ -51,182 +110,631 @@ byte_to_sector (const struct inode *inode, off_t pos)
 {
   ASSERT (inode != NULL);
   if (pos < inode->data.length) {
-    return sector_number(&inode->data, pos/BLOCK_SECTOR_SIZE);
+    off_t sector = pos / BLOCK_SECTOR_SIZE;
+    block_sector_t block = sector_number (&inode->data,
+                                          sector / block_sectors);
+    if (block == SECTOR_NONE)
+      return -1;
+    return block + sector % block_sectors;
   }
   else
     return -1;
 }
+/* Reads SECTOR of INODE's contents into BUFFER.  Directory
+   contents are checksummed metadata. */
+static void
+read_sector (const struct inode *inode, block_sector_t sector, void *buffer)
+{
+  if (inode->data.is_dir)
+    buffer_cache_read_meta (sector, buffer);
+  else
+    buffer_cache_read (sector, buffer);
+}
+
+/* Writes BUFFER to SECTOR, sector INDEX of INODE's contents.
+   The contents of directories, the free map and the reference
+   counts are file system metadata, written through the journal;
+   only directories are checksummed, since the others use every
+   bit of their sectors.
+
+   With deduplication, a data sector identical to an indexed one
+   is shared with it instead of being written, and a shared
+   sector is copied before it is changed.  Returns false if disk
+   space runs out for the copy. */
+static bool
+write_sector (struct inode *inode, size_t index, block_sector_t sector,
+              const void *buffer)
+{
+  block_sector_t other;
+  bool success = true;
+
+  if (inode->data.is_dir)
+    buffer_cache_write_meta (sector, buffer, true);
+  else if (inode->sector == FREE_MAP_SECTOR
+           || inode->sector == REFCOUNT_SECTOR)
+    buffer_cache_write_meta (sector, buffer, false);
+  else if (!dedup_enabled ())
+    buffer_cache_write (sector, buffer);
+  else
+    {
+      /* A new reference commits with the block map update that
+         accounts for it. */
+      journal_begin ();
+      if (free_map_share_data (buffer, sector, &other))
+        {
+          if (other != sector)
+            {
+              set_sector_number (inode, index, other);
+              free_map_release (sector, 1);
+            }
+        }
+      else
+        {
+          if (!free_map_exclusive (sector))
+            {
+              success = free_map_allocate (1, &other);
+              if (success)
+                {
+                  set_sector_number (inode, index, other);
+                  free_map_release (sector, 1);
+                }
+              sector = other;
+            }
+          if (success)
+            {
+              buffer_cache_write (sector, buffer);
+              dedup_add (sector, buffer);
+            }
+        }
+      journal_end ();
+    }
+  return success;
+}
+
+/* Allocates a zeroed data block for DISK and stores its first
+   sector into *SECTOR.  With deduplication, which implies
+   single-sector blocks, those of regular files all share one
+   sector until written; directories are written in place, so
+   they can't. */
+static bool
+alloc_zero_block (const struct inode_disk *disk, block_sector_t *sector)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+  unsigned i;
+
+  if (!disk->is_dir && free_map_share_data (zeros, 0, sector))
+    return true;
+  if (!free_map_allocate (block_sectors, sector))
+    return false;
+  for (i = 0; i < block_sectors; i++)
+    buffer_cache_write (*sector + i, zeros);
+  dedup_add (*sector, zeros);
+  return true;
+}
 static inline size_t
 bytes_to_sectors (off_t size)
 {
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
-bool reserve_indir (block_sector_t* page, size_t num, int level){
-  static char free[BLOCK_SECTOR_SIZE];
-  struct indir_inode indir_block;
-  int chunk,max,nmax; 
-  bool res = true;
-  if(level > 2)
-	  exit(-1);
+
+/* Returns the number of block map entries for a file of LENGTH
+   bytes.  A compressed file's block map covers whole clusters. */
+static size_t
+map_blocks (const struct inode_disk *disk, off_t length)
+{
+  size_t num_blk = DIV_ROUND_UP (length, block_sectors * BLOCK_SECTOR_SIZE);
+  return disk->compressed ? ROUND_UP (num_blk, CLUSTER_SECTORS) : num_blk;
+}
+
+/* Returns the number of data blocks reachable through a block
+   pointer with LEVEL levels of indirection. */
+static size_t
+level_span (int level)
+{
+  size_t span = 1;
+
+  for (; level > 0; level--)
+    span *= INDIRECT;
+  return span;
+}
+
+/* Returns the most block map entries an inode can hold. */
+static size_t
+max_blocks (void)
+{
+  size_t cnt = DIRECT;
+  int level;
+
+  for (level = 1; level <= INDIR_LEVELS; level++)
+    cnt += level_span (level);
+  return cnt;
+}
+/* Fills the NUM block map entries of DISK below PAGE, which has
+   LEVEL levels of indirection.  Data sectors of compressed files
+   are left unallocated.  Indirect blocks are kept off the stack,
+   since this recurses once per level.  Only indirect blocks that
+   change are written, so growing a file logs the few it touches
+   rather than all of them. */
+bool reserve_indir (block_sector_t* page, size_t num, int level,
+                    const struct inode_disk *disk){
+  struct indir_inode *indir_block;
+  size_t chunk,max,nmax; 
+  block_sector_t old;
+  bool res = true, changed = false;
   if (level == 0) {
-    if (*page == 0) {
-      if(! free_map_allocate (1, page))
+    if (*page == 0 && !disk->compressed) {
+      if(! alloc_zero_block (disk, page))
         return res == false;
-      buffer_cache_write (*page,free);
     }
     return res;
   }
-  if(level > 1)
-	  chunk = INDIRECT;
-  else
-	  chunk = 1;
+  chunk = level_span (level - 1);
+  indir_block = malloc (sizeof *indir_block);
+  if (indir_block == NULL)
+    return res == false;
   if(*page == 0) {
-    free_map_allocate (1, page);
-    buffer_cache_write (*page, free);
+    if(! free_map_allocate (1, page)) {
+      free (indir_block);
+      return res == false;
+    }
+    memset (indir_block, 0, sizeof *indir_block);
+    changed = true;
   }
-  buffer_cache_read(*page, &indir_block);
+  else
+    buffer_cache_read_meta (*page, indir_block);
   max = DIV_ROUND_UP (num, chunk);
-  for (int i = 0; i < max; i++) {
+  for (size_t i = 0; i < max && res; i++) {
     nmax = num < chunk ? num : chunk;
-    if(!reserve_indir(&indir_block.block[i], nmax, level - 1))
-      return res == false;
+    old = indir_block->block[i];
+    res = reserve_indir(&indir_block->block[i], nmax, level - 1, disk);
+    changed |= indir_block->block[i] != old;
     num -= nmax;
   }
-  if(num != 0)
-	exit(-1);
-  buffer_cache_write (*page, &indir_block);
+  /* Write back even on failure so nothing allocated is lost. */
+  if (changed)
+    buffer_cache_write_meta (*page, indir_block, true);
+  free (indir_block);
   return res;
 }
 
+/* Grows the block map of PAGE to cover LEN bytes.  Returns false
+   if LEN is beyond what the triply indirect block can reach or
+   the disk is full. */
 bool inode_reserve (struct inode_disk *page, int len)
 {
-  static char free[BLOCK_SECTOR_SIZE];
   if (len < 0) 
 	return false;
-  int num_sec=bytes_to_sectors(len);
-  int max;
+  size_t num_sec=map_blocks(page, len);
+  size_t max;
   bool res = true;
+  if (num_sec > max_blocks ())
+    return res == false;
   // direct blocks
   max = num_sec < DIRECT ? num_sec: DIRECT;
-  for (int i = 0; i < max;i++) {
-    if (page->dir_blocks[i] == 0) { 
-      if(! free_map_allocate(1, &page->dir_blocks[i]))
+  for (size_t i = 0; i < max;i++) {
+    if (page->dir_blocks[i] == 0 && !page->compressed) { 
+      if(! alloc_zero_block (page, &page->dir_blocks[i]))
         return res == false;
-      buffer_cache_write (page->dir_blocks[i],free);
     }
   }
   num_sec -= max;
-  if(num_sec == 0) 
-	  return res;
-  //indirect block
-  max = num_sec < INDIRECT ? num_sec : INDIRECT;
-  if(!reserve_indir(&page->indir_block,max, 1))
-    return res == false;
-  num_sec -= max;
-  if(num_sec == 0) 
-	  return res;
-  //double indirect block
-  max = num_sec <  INDIRECT * INDIRECT ? num_sec : INDIRECT*INDIRECT;
-  if(!reserve_indir(&page->d_indir_block,max, 2))
-    return res ==false;
-  num_sec -= max;
-  if(num_sec == 0) 
-	  return res;
-  if(num_sec != 0)
-	  exit(-1);
-  return res == false;
+  // singly, doubly, then triply indirect blocks
+  for (int level = 1; num_sec > 0; level++) {
+    max = num_sec < level_span (level) ? num_sec : level_span (level);
+    if(!reserve_indir(&page->indir_blocks[level - 1], max, level, page))
+      return res == false;
+    num_sec -= max;
+  }
+  return res;
 }
 
-void delete_indir(block_sector_t ent, size_t num_sec, int level)
+/* Releases CNT sectors at SECTOR for a deletion, which is split
+   into a new journal operation every DELETE_BATCH releases.  Each
+   release logs at most two free map sectors and one reference
+   count sector, so a batch stays within JOURNAL_OP_MAX.  A crash
+   in between leaves the rest of an unreachable inode allocated,
+   for fsck -repair to reclaim. */
+static void
+delete_release (block_sector_t sector, size_t cnt, size_t *released)
 {
-  int chunk;
-  if(level > 2)
-	  exit(-1);
-  else if(level == 0) {
-    free_map_release(ent, 1);
+  free_map_release (sector, cnt);
+  if (++*released % DELETE_BATCH == 0)
+    {
+      journal_end ();
+      journal_begin ();
+    }
+}
+
+/* Releases indirect block ENT, which has LEVEL levels of
+   indirection, and the NUM_SEC data blocks below it.  *RELEASED
+   counts releases for delete_release(). */
+void delete_indir(block_sector_t ent, size_t num_sec, int level,
+                  size_t *released)
+{
+  size_t chunk;
+  if(level == 0) {
+    if (ent != 0) // hole in a compressed file
+      delete_release (ent, block_sectors, released);
     return;
   }
-  else if(level == 1)
-	  chunk = 1;
-  else
-	  chunk = INDIRECT;
-  int nmax,max = DIV_ROUND_UP (num_sec, chunk);
-  struct indir_inode indir_block;
-  buffer_cache_read(ent, &indir_block);
-  for (int i = 0; i < max;i++) {
+  chunk = level_span (level - 1);
+  size_t nmax,max = DIV_ROUND_UP (num_sec, chunk);
+  struct indir_inode *indir_block = malloc (sizeof *indir_block);
+  if (indir_block == NULL)
+    return;               // leaks the subtree; fsck -repair reclaims it
+  buffer_cache_read_meta (ent, indir_block);
+  for (size_t i = 0; i < max;i++) {
     nmax = num_sec < chunk ? num_sec : chunk;
-    delete_indir(indir_block.block[i],nmax, level - 1);
+    delete_indir(indir_block->block[i],nmax, level - 1, released);
     num_sec -= nmax;
   }
-  if(num_sec != 0)
-	  exit(-1);
-  free_map_release (ent, 1);
+  free (indir_block);
+  delete_release (ent, 1, released);
 }
 
+/* Releases the sector of removed inode ID and all its blocks,
+   committing along the way.  Must be called outside any journal
+   operation. */
 bool inode_delete(struct inode *id)
 {
+  size_t released = 0;
   bool res = true;
   if(id->data.length < 0) 
 	  return res == false;
-  int num_sec = bytes_to_sectors(id->data.length), max;
+  size_t num_sec = map_blocks(&id->data, id->data.length), max;
+  if (num_sec > max_blocks ())
+    return res == false;
+  ASSERT (!journal_in_op ());
+  journal_begin ();
+  delete_release (id->sector, 1, &released);
   max = num_sec < DIRECT ? num_sec: DIRECT;
-  for (int i = 0; i < max;i++) {
-    free_map_release (id->data.dir_blocks[i], 1);
+  for (size_t i = 0; i < max;i++) {
+    if (id->data.dir_blocks[i] != 0)
+      delete_release (id->data.dir_blocks[i], block_sectors, &released);
   }
   num_sec -= max;
-  max = num_sec <  INDIRECT ? num_sec : INDIRECT;
-  if(max > 0) {
-    delete_indir(id->data.indir_block,max, 1);
+  for (int level = 1; num_sec > 0; level++) {
+    max = num_sec < level_span (level) ? num_sec : level_span (level);
+    delete_indir(id->data.indir_blocks[level - 1], max, level, &released);
     num_sec -= max;
   }
-  max = num_sec < INDIRECT * INDIRECT ? num_sec : INDIRECT*INDIRECT;
-  if(max > 0) {
-    delete_indir(id->data.d_indir_block,max, 2);
-    num_sec -= max;
-  }
-  if(num_sec != 0)
-	  exit(-1);
+  journal_end ();
   return res;
 }
 
+/* Returns block map entry INDEX of IDISK, or 0 if there is none.
+   Returns SECTOR_NONE if INDEX is out of range or a block map
+   sector can't be read.  Walks down one indirect block per
+   level, so a lookup reads at most INDIR_LEVELS block map
+   sectors. */
 block_sector_t sector_number (struct inode_disk *idisk, off_t index)
 {
-  struct indir_inode *indir_idisk;
-  int ibase = 0, imax = 0;  
+  struct indir_inode indir_block;
+  size_t idx = index, span;
   block_sector_t res;
-  imax = imax + DIRECT;
-  if (index < imax) 
-    return idisk->dir_blocks[index];
-  ibase = imax;
-  imax = imax + INDIRECT;
-  if (index < imax) {
-    indir_idisk = calloc(1, sizeof(struct indir_inode));
-    buffer_cache_read(idisk->indir_block, indir_idisk);
-    res = indir_idisk->block[(index - ibase)];
-    free(indir_idisk);
-    return res;
+  int level;
+
+  if (index < 0)
+    return SECTOR_NONE;
+  if (idx < DIRECT) 
+    return idisk->dir_blocks[idx];
+  idx -= DIRECT;
+  for (level = 1; level <= INDIR_LEVELS; level++) {
+    span = level_span (level);
+    if (idx < span)
+      break;
+    idx -= span;
   }
-  ibase = imax;
-  imax = imax + INDIRECT * INDIRECT;
-  if (index < imax) {
-    indir_idisk = calloc(1, sizeof(struct indir_inode));
-    buffer_cache_read(idisk->d_indir_block, indir_idisk);
-    buffer_cache_read(indir_idisk->block[(index-ibase)/INDIRECT], indir_idisk);
-    res = indir_idisk->block[(index-ibase)%INDIRECT];
-    free(indir_idisk);
-    return res;
+  if (level > INDIR_LEVELS)
+    return SECTOR_NONE;
+  res = idisk->indir_blocks[level - 1];
+  for (; level > 0 && res != 0; level--) {
+    span = level_span (level - 1);
+    if (!buffer_cache_read_meta (res, &indir_block))
+      return SECTOR_NONE;
+    res = indir_block.block[idx / span];
+    idx %= span;
   }
-  return NULL;
+  return res;
+}
+
+/* Points block map entry INDEX of INODE at SECTOR.  The indirect
+   blocks leading to it must already exist. */
+static void
+set_sector_number (struct inode *inode, size_t index, block_sector_t sector)
+{
+  struct indir_inode indir_block;
+  block_sector_t blk;
+  size_t span;
+  int level;
+
+  lock_acquire (&inode->lock);
+  if (index < DIRECT)
+    {
+      inode->data.dir_blocks[index] = sector;
+      buffer_cache_write_meta (inode->sector, &inode->data, true);
+      lock_release (&inode->lock);
+      return;
+    }
+  index -= DIRECT;
+  for (level = 1; index >= level_span (level); level++)
+    index -= level_span (level);
+  ASSERT (level <= INDIR_LEVELS);
+  blk = inode->data.indir_blocks[level - 1];
+  for (; level > 1; level--)
+    {
+      span = level_span (level - 1);
+      buffer_cache_read_meta (blk, &indir_block);
+      blk = indir_block.block[index / span];
+      index %= span;
+    }
+  buffer_cache_read_meta (blk, &indir_block);
+  indir_block.block[index] = sector;
+  buffer_cache_write_meta (blk, &indir_block, true);
+  lock_release (&inode->lock);
+}
+
+/* Stores the sectors holding cluster IDX of INODE into SECTORS
+   and returns how many there are.  An unreadable block map entry
+   ends the cluster, which then fails to decompress. */
+static size_t
+cluster_sectors (struct inode *inode, off_t idx,
+                 block_sector_t sectors[CLUSTER_SECTORS])
+{
+  size_t i;
+
+  for (i = 0; i < CLUSTER_SECTORS; i++)
+    {
+      sectors[i] = sector_number (&inode->data, idx * CLUSTER_SECTORS + i);
+      if (sectors[i] == 0 || sectors[i] == SECTOR_NONE)
+        break;
+    }
+  return i;
 }
+
+/* Makes INODE->cluster hold cluster IDX of compressed INODE.
+   Returns false if memory runs out or the cluster is corrupt. */
+static bool
+load_cluster (struct inode *inode, off_t idx)
+{
+  block_sector_t sectors[CLUSTER_SECTORS];
+  uint8_t *packed;
+  uint16_t size;
+  size_t cnt, i;
+  bool ok = true;
+
+  ASSERT (lock_held_by_current_thread (&inode->cluster_lock));
+  if (inode->cluster == NULL)
+    {
+      inode->cluster = malloc (CLUSTER_SIZE);
+      if (inode->cluster == NULL)
+        return false;
+    }
+  else if (inode->cluster_idx == idx)
+    return true;
+
+  inode->cluster_idx = -1;
+  cnt = cluster_sectors (inode, idx, sectors);
+  if (cnt == 0)
+    memset (inode->cluster, 0, CLUSTER_SIZE);
+  else if (cnt == CLUSTER_SECTORS)
+    for (i = 0; i < cnt; i++)
+      buffer_cache_read (sectors[i], inode->cluster + i * BLOCK_SECTOR_SIZE);
+  else
+    {
+      packed = malloc (cnt * BLOCK_SECTOR_SIZE);
+      if (packed == NULL)
+        return false;
+      for (i = 0; i < cnt; i++)
+        buffer_cache_read (sectors[i], packed + i * BLOCK_SECTOR_SIZE);
+      memcpy (&size, packed, sizeof size);
+      ok = (size <= cnt * BLOCK_SECTOR_SIZE - sizeof size
+            && lz_decompress (packed + sizeof size, size, inode->cluster,
+                              CLUSTER_SIZE) == CLUSTER_SIZE);
+      free (packed);
+      if (!ok)
+        printf ("inode %"PRDSNu": cluster %"PROTd" is corrupt\n",
+                inode->sector, idx);
+    }
+  if (ok)
+    inode->cluster_idx = idx;
+  return ok;
+}
+
+/* Compresses INODE->cluster and writes it back, growing or
+   shrinking its share of the block map to fit.  Returns false if
+   memory or disk space runs out. */
+static bool
+store_cluster (struct inode *inode)
+{
+  block_sector_t sectors[CLUSTER_SECTORS];
+  const uint8_t *src = inode->cluster;
+  off_t idx = inode->cluster_idx;
+  uint8_t *packed, *work;
+  size_t cnt, old_cnt, size, i;
+  bool success = true;
+
+  ASSERT (lock_held_by_current_thread (&inode->cluster_lock));
+  ASSERT (idx >= 0);
+
+  packed = malloc (CLUSTER_SIZE);
+  work = malloc (LZ_WORK_SIZE);
+  if (packed == NULL || work == NULL)
+    {
+      free (packed);
+      free (work);
+      return false;
+    }
+
+  /* Worth keeping compressed only if it saves a sector. */
+  for (i = 0; i < CLUSTER_SIZE && src[i] == 0; i++)
+    continue;
+  if (i == CLUSTER_SIZE)
+    cnt = 0;
+  else
+    {
+      size = lz_compress (src, CLUSTER_SIZE, packed + 2,
+                          CLUSTER_SIZE - BLOCK_SECTOR_SIZE - 2, work);
+      if (size == 0)
+        cnt = CLUSTER_SECTORS;
+      else
+        {
+          packed[0] = size & 0xff;
+          packed[1] = size >> 8;
+          cnt = DIV_ROUND_UP (size + 2, BLOCK_SECTOR_SIZE);
+          memset (packed + size + 2, 0, cnt * BLOCK_SECTOR_SIZE - size - 2);
+          src = packed;
+        }
+    }
+
+  journal_begin ();
+  old_cnt = cluster_sectors (inode, idx, sectors);
+  for (i = old_cnt; i < cnt; i++)
+    {
+      if (!free_map_allocate (1, &sectors[i]))
+        {
+          /* Give back what we got, leaving the old cluster. */
+          while (i-- > old_cnt)
+            {
+              free_map_release (sectors[i], 1);
+              set_sector_number (inode, idx * CLUSTER_SECTORS + i, 0);
+            }
+          success = false;
+          break;
+        }
+      set_sector_number (inode, idx * CLUSTER_SECTORS + i, sectors[i]);
+    }
+  if (success)
+    {
+      for (i = cnt; i < old_cnt; i++)
+        {
+          free_map_release (sectors[i], 1);
+          set_sector_number (inode, idx * CLUSTER_SECTORS + i, 0);
+        }
+      for (i = 0; i < cnt; i++)
+        buffer_cache_write (sectors[i], src + i * BLOCK_SECTOR_SIZE);
+    }
+  journal_end ();
+
+  /* The cluster in memory no longer matches the one on disk. */
+  if (!success)
+    inode->cluster_idx = -1;
+  free (packed);
+  free (work);
+  return success;
+}
+
+/* inode_read_at() for compressed files.  BUFFER may be in user
+   memory, so it is filled from a kernel copy of each chunk after
+   cluster_lock is released. */
+static off_t
+cluster_read_at (struct inode *inode, uint8_t *buffer, off_t size,
+                 off_t offset)
+{
+  off_t bytes_read = 0;
+  uint8_t *bounce;
+  bool ok;
+
+  bounce = malloc (CLUSTER_SIZE);
+  if (bounce == NULL)
+    return 0;
+  while (size > 0)
+    {
+      int cluster_ofs = offset % CLUSTER_SIZE;
+      off_t inode_left = inode_length (inode) - offset;
+      int cluster_left = CLUSTER_SIZE - cluster_ofs;
+      int min_left = inode_left < cluster_left ? inode_left : cluster_left;
+      int chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+      lock_acquire (&inode->cluster_lock);
+      ok = load_cluster (inode, offset / CLUSTER_SIZE);
+      if (ok)
+        memcpy (bounce, inode->cluster + cluster_ofs, chunk_size);
+      lock_release (&inode->cluster_lock);
+      if (!ok)
+        break;
+      memcpy (buffer + bytes_read, bounce, chunk_size);
+
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_read += chunk_size;
+    }
+  free (bounce);
+  return bytes_read;
+}
+
+/* inode_write_at() for compressed files, once the file has been
+   extended to cover the write.  BUFFER may be in user memory, so
+   each chunk is copied into the kernel before cluster_lock is
+   taken. */
+static off_t
+cluster_write_at (struct inode *inode, const uint8_t *buffer, off_t size,
+                  off_t offset)
+{
+  off_t bytes_written = 0;
+  uint8_t *bounce;
+  bool ok;
+
+  bounce = malloc (CLUSTER_SIZE);
+  if (bounce == NULL)
+    return 0;
+  while (size > 0)
+    {
+      int cluster_ofs = offset % CLUSTER_SIZE;
+      off_t inode_left = inode_length (inode) - offset;
+      int cluster_left = CLUSTER_SIZE - cluster_ofs;
+      int min_left = inode_left < cluster_left ? inode_left : cluster_left;
+      int chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+      memcpy (bounce, buffer + bytes_written, chunk_size);
+      lock_acquire (&inode->cluster_lock);
+      ok = load_cluster (inode, offset / CLUSTER_SIZE);
+      if (ok)
+        {
+          memcpy (inode->cluster + cluster_ofs, bounce, chunk_size);
+          ok = store_cluster (inode);
+        }
+      lock_release (&inode->cluster_lock);
+      if (!ok)
+        break;
+
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_written += chunk_size;
+    }
+  free (bounce);
+  return bytes_written;
+}
+
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
 static struct list open_inodes;
+static struct lock open_inodes_lock;    /* Guards the list and open_cnt. */
+
+/* Closed inodes waiting for inode_reap() to delete them. */
+static struct list orphans;
+static struct lock orphans_lock;
+
+/* Sets the number of sectors in a data block to SECTORS, a
+   power of 2, for the file system being mounted or formatted. */
+void
+inode_set_block_size (unsigned sectors)
+{
+  ASSERT (sectors > 0 && (sectors & (sectors - 1)) == 0);
+  block_sectors = sectors;
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void)
 {
+  ASSERT (sizeof (struct indir_inode) == BLOCK_SECTOR_SIZE);
   list_init (&open_inodes);
+  lock_init (&open_inodes_lock);
+  list_init (&orphans);
+  lock_init (&orphans_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -254,7 +762,7 @@ inode_create (block_sector_t sector, off_t length, bool is_dir)
       disk_inode->magic = INODE_MAGIC;
       if (inode_new(disk_inode))
         {
-          buffer_cache_write (sector, disk_inode);
+          buffer_cache_write_meta (sector, disk_inode, true);
           success = true;
         }
       free (disk_inode);
@@ -264,7 +772,8 @@ inode_create (block_sector_t sector, off_t length, bool is_dir)
 
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
-   Returns a null pointer if memory allocation fails. */
+   Returns a null pointer if memory allocation fails or SECTOR
+   does not hold a valid inode. */
 struct inode *
 inode_open (block_sector_t sector)
 {
@@ -272,13 +781,15 @@ inode_open (block_sector_t sector)
   struct inode *inode;
 
   /* Check whether this inode is already open. */
+  lock_acquire (&open_inodes_lock);
   for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
        e = list_next (e))
     {
       inode = list_entry (e, struct inode, elem);
       if (inode->sector == sector)
         {
-          inode_reopen (inode);
+          inode->open_cnt++;
+          lock_release (&open_inodes_lock);
           return inode;
         }
     }
@@ -286,7 +797,21 @@ inode_open (block_sector_t sector)
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
+
+  /* Read and check the on-disk inode. */
+  if (!buffer_cache_read_meta (sector, &inode->data)
+      || inode->data.magic != INODE_MAGIC)
+    {
+      printf ("inode: sector %"PRDSNu" does not hold a valid inode\n",
+              sector);
+      free (inode);
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
   list_push_front (&open_inodes, &inode->elem);
@@ -294,7 +819,13 @@ inode_open (block_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  buffer_cache_read (inode->sector, &inode->data);
+  inode->gen = new_gen ();
+  lock_init (&inode->lock);
+  lock_init (&inode->sector_lock);
+  lock_init (&inode->cluster_lock);
+  inode->cluster = NULL;
+  inode->cluster_idx = -1;
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -303,10 +834,24 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
+/* Returns INODE's generation.  It changes after every write, and
+   an inode opened afresh gets one it never had, so equal
+   generations mean equal contents as long as the inode stays
+   open. */
+unsigned
+inode_generation (const struct inode *inode)
+{
+  return inode->gen;
+}
+
 /* Returns INODE's inode number. */
 block_sector_t
 inode_get_inumber (const struct inode *inode)
@@ -325,18 +870,51 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  if (--inode->open_cnt > 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
+      lock_release (&open_inodes_lock);
+      return;
+    }
 
-      /* Deallocate blocks if removed. */
-      if (inode->removed)
-        {
-          free_map_release (inode->sector, 1);
-          inode_delete(inode);
-        }
+  /* Remove from inode list and release lock. */
+  list_remove (&inode->elem);
+  lock_release (&open_inodes_lock);
+
+  /* Deallocate blocks if removed.  That takes journal operations
+     of its own, so inside one it waits for inode_reap(). */
+  if (inode->removed)
+    {
+      lock_acquire (&orphans_lock);
+      list_push_back (&orphans, &inode->elem);
+      lock_release (&orphans_lock);
+      if (!journal_in_op ())
+        inode_reap ();
+      return;
+    }
+
+  free (inode->cluster);
+  free (inode);
+}
+
+/* Deletes the removed inodes whose last opener closed them inside
+   a journal operation.  Called outside any operation, after one
+   that may have removed a file. */
+void
+inode_reap (void)
+{
+  struct inode *inode;
 
+  for (;;)
+    {
+      lock_acquire (&orphans_lock);
+      inode = (list_empty (&orphans) ? NULL
+               : list_entry (list_pop_front (&orphans), struct inode, elem));
+      lock_release (&orphans_lock);
+      if (inode == NULL)
+        break;
+      inode_delete (inode);
+      free (inode->cluster);
       free (inode);
     }
 }
@@ -352,7 +930,10 @@ inode_remove (struct inode *inode)
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+   BUFFER may be in user memory, where touching it can fault and
+   page in a mapped file, so it is never handed to the buffer
+   cache: every sector goes through a kernel bounce buffer. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
@@ -360,6 +941,9 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   off_t bytes_read = 0;
   uint8_t *bounce = NULL;
 
+  if (inode->data.compressed)
+    return cluster_read_at (inode, buffer, size, offset);
+
   while (size > 0)
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -376,24 +960,18 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* Read sector into bounce buffer, then copy into caller's
+         buffer. */
+      if (bounce == NULL)
         {
-          /* Read full sector directly into caller's buffer. */
-          buffer_cache_read (sector_idx, buffer + bytes_read);
-        }
-      else
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
+          bounce = malloc (BLOCK_SECTOR_SIZE);
           if (bounce == NULL)
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          buffer_cache_read (sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+            break;
         }
+      if (sector_idx == -1u)
+        break;
+      read_sector (inode, sector_idx, bounce);
+      memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
@@ -405,10 +983,47 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   return bytes_read;
 }
 
+/* Grows INODE to LEN bytes if it is shorter, EXTEND_BLOCKS
+   blocks per journal operation.  Returns false if writes are
+   denied or the disk is full, in which case INODE may have grown
+   part of the way.  The journal handle is taken before the inode
+   lock, since a thread waiting for a commit holds no inode
+   lock. */
+bool
+inode_extend (struct inode *inode, off_t len)
+{
+  off_t block_size = block_sectors * BLOCK_SECTOR_SIZE, step;
+  bool success = true;
+
+  if (inode->deny_write_cnt)
+    return false;
+  while (success && inode->data.length < len) {
+    journal_begin ();
+    lock_acquire (&inode->lock);
+    if (inode->data.length < len) {
+      step = (DIV_ROUND_UP (inode->data.length, block_size)
+              + EXTEND_BLOCKS) * block_size;
+      if (step > len)
+        step = len;
+      success = inode_reserve(& inode->data,step);
+      if (success) {
+        inode->data.length = step;
+        inode->gen = new_gen ();
+        buffer_cache_write_meta(inode->sector, &inode->data, true);
+      }
+    }
+    lock_release (&inode->lock);
+    journal_end ();
+  }
+  return success;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
    (Normally a write at end of file would extend the inode).
+   As in inode_read_at(), BUFFER only reaches the buffer cache
+   through a kernel bounce buffer.
    */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
@@ -416,23 +1031,27 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
-  bool success;
-  int len;
+  uint8_t *bounce = NULL, *stage;
+  bool shared, ok;
   if (inode->deny_write_cnt)
     return 0;
-  len = offset+size;
-  if(byte_to_sector(inode, len-1)==-1u){
-    if((inode_reserve(& inode->data,len)) == false)
-    	return 0;  
-    inode->data.length = len;
-    buffer_cache_write(inode->sector, &inode->data);
-  }
+  if (!inode_extend (inode, offset + size))
+    return 0;
+  if (inode->data.compressed)
+    {
+      bytes_written = cluster_write_at (inode, buffer, size, offset);
+      inode->gen = new_gen ();
+      return bytes_written;
+    }
 
+  /* Can write_sector() share or copy this file's sectors? */
+  shared = (dedup_enabled () && !inode->data.is_dir
+            && inode->sector != FREE_MAP_SECTOR
+            && inode->sector != REFCOUNT_SECTOR);
   while (size > 0)
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -445,31 +1064,43 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          buffer_cache_write (sector_idx, buffer + bytes_written);
-        }
-      else
+      /* The chunk is copied to STAGE, the second half of the
+         buffer, before any lock is taken, since a fault on the
+         user's buffer could write back a mapped page of this very
+         file.  The sector is then built in BOUNCE. */
+      if (bounce == NULL)
         {
-          /* We need a bounce buffer. */
+          bounce = malloc (2 * BLOCK_SECTOR_SIZE);
           if (bounce == NULL)
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
+            break;
+        }
+      stage = bounce + BLOCK_SECTOR_SIZE;
+      memcpy (stage, buffer + bytes_written, chunk_size);
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
+      /* If the sector contains data before or after the chunk,
+         it is read, patched and written back under sector_lock,
+         or a concurrent writer of other bytes of it would be
+         lost.  The sector is looked up again under the lock,
+         because a writer may have moved a shared sector.  Moving
+         one takes a journal handle, which must come first. */
+      if (shared)
+        journal_begin ();
+      lock_acquire (&inode->sector_lock);
+      sector_idx = byte_to_sector (inode, offset);
+      ok = sector_idx != -1u;
+      if (ok)
+        {
           if (sector_ofs > 0 || chunk_size < sector_left)
-            buffer_cache_read (sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          buffer_cache_write (sector_idx, bounce);
+            read_sector (inode, sector_idx, bounce);
+          memcpy (bounce + sector_ofs, stage, chunk_size);
+          ok = write_sector (inode, offset / BLOCK_SECTOR_SIZE, sector_idx,
+                             bounce);
         }
+      lock_release (&inode->sector_lock);
+      if (shared)
+        journal_end ();
+      if (!ok)
+        break;
 
       /* Advance. */
       size -= chunk_size;
@@ -477,10 +1108,90 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       bytes_written += chunk_size;
     }
   free (bounce);
+  inode->gen = new_gen ();
 
   return bytes_written;
 }
 
+/* Makes data sector DST_IDX of DST the same disk sector as data
+   sector SRC_IDX of SRC, adding a reference to it.  Later writes
+   to either copy it first, as in write_sector().  The reference
+   and the block map update are one journal operation, so a crash
+   can't leave a count no block map accounts for.  Returns false
+   if the sector can't be shared. */
+static bool
+share_sector (struct inode *dst, size_t dst_idx,
+              struct inode *src, size_t src_idx)
+{
+  block_sector_t sector = sector_number (&src->data, src_idx);
+  block_sector_t old = sector_number (&dst->data, dst_idx);
+  bool success;
+
+  if (sector == SECTOR_NONE || old == SECTOR_NONE)
+    return false;
+  if (sector == old)
+    return true;
+  journal_begin ();
+  success = free_map_share (sector);
+  if (success)
+    {
+      set_sector_number (dst, dst_idx, sector);
+      free_map_release (old, 1);
+    }
+  journal_end ();
+  return success;
+}
+
+/* Copies SIZE bytes from SRC, starting at SRC_OFS, into DST,
+   starting at DST_OFS, through one kernel sector buffer.  DST is
+   grown once, up front.  With deduplication, whole sectors at
+   sector-aligned offsets of uncompressed files are shared rather
+   than copied.  Returns the number of bytes copied, which is
+   less than SIZE at end of SRC or if DST can't grow. */
+off_t
+inode_copy (struct inode *dst, off_t dst_ofs, struct inode *src,
+            off_t src_ofs, off_t size)
+{
+  uint8_t *bounce;
+  off_t bytes_copied = 0;
+  bool share;
+
+  if (size > inode_length (src) - src_ofs)
+    size = inode_length (src) - src_ofs;
+  if (size <= 0 || src->data.is_dir || dst->data.is_dir
+      || !inode_extend (dst, dst_ofs + size))
+    return 0;
+  bounce = malloc (BLOCK_SECTOR_SIZE);
+  if (bounce == NULL)
+    return 0;
+  share = (dedup_enabled () && !src->data.compressed
+           && !dst->data.compressed);
+
+  while (bytes_copied < size)
+    {
+      /* Copy up to the end of the destination sector. */
+      off_t chunk = BLOCK_SECTOR_SIZE - dst_ofs % BLOCK_SECTOR_SIZE;
+      if (chunk > size - bytes_copied)
+        chunk = size - bytes_copied;
+
+      if (share && chunk == BLOCK_SECTOR_SIZE
+          && src_ofs % BLOCK_SECTOR_SIZE == 0
+          && share_sector (dst, dst_ofs / BLOCK_SECTOR_SIZE,
+                           src, src_ofs / BLOCK_SECTOR_SIZE))
+        ;
+      else if (inode_read_at (src, bounce, chunk, src_ofs) != chunk
+               || inode_write_at (dst, bounce, chunk, dst_ofs) != chunk)
+        break;
+
+      src_ofs += chunk;
+      dst_ofs += chunk;
+      bytes_copied += chunk;
+    }
+  free (bounce);
+  dst->gen = new_gen ();
+  return bytes_copied;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -522,6 +1233,177 @@ is_inode_rm(const struct inode *inode)
   return inode->removed;
 }
 
+/* Shares each data sector of regular file INODE that is
+   identical to an indexed one, and indexes the rest.  Each
+   sector is shared in one journal operation, as in
+   share_sector().  Returns the number of sectors freed. */
+size_t
+inode_dedup (struct inode *inode)
+{
+  block_sector_t sector, other;
+  uint8_t *data;
+  size_t cnt, i, freed = 0;
+
+  if (!dedup_enabled () || inode->data.is_dir || inode->data.compressed)
+    return 0;
+  data = malloc (BLOCK_SECTOR_SIZE);
+  if (data == NULL)
+    return 0;
+  cnt = bytes_to_sectors (inode->data.length);
+  for (i = 0; i < cnt; i++)
+    {
+      sector = sector_number (&inode->data, i);
+      if (sector == SECTOR_NONE)
+        continue;
+      buffer_cache_read (sector, data);
+      journal_begin ();
+      if (!free_map_share_data (data, sector, &other))
+        dedup_add (sector, data);
+      else if (other != sector)
+        {
+          if (!free_map_shared (sector))
+            freed++;
+          set_sector_number (inode, i, other);
+          free_map_release (sector, 1);
+        }
+      journal_end ();
+    }
+  free (data);
+  return freed;
+}
+
+/* Makes INODE store its data compressed.  Only an empty regular
+   file can be switched, and only where data blocks are single
+   sectors, since clusters are mapped sector by sector.  Returns
+   true if successful. */
+bool
+inode_set_compressed (struct inode *inode)
+{
+  if (inode->data.is_dir || inode->data.length != 0 || block_sectors > 1)
+    return false;
+  if (!inode->data.compressed)
+    {
+      journal_begin ();
+      inode->data.compressed = true;
+      buffer_cache_write_meta (inode->sector, &inode->data, true);
+      journal_end ();
+    }
+  return true;
+}
+
+/* Marks the CNT sectors at block pointer SECTOR of inode OWNER
+   in USED, the set of sectors found in use so far.  Reports and
+   counts in *ERRORS a pointer that is out of range or already in
+   use. */
+static bool
+check_sector (block_sector_t owner, block_sector_t sector, size_t cnt,
+              struct bitmap *used, size_t *errors)
+{
+  if (sector == 0 || sector + cnt > bitmap_size (used))
+    printf ("fsck: inode %"PRDSNu": bad block pointer %"PRDSNu"\n",
+            owner, sector);
+  else if (bitmap_any (used, sector, cnt))
+    {
+      if (cnt == 1 && free_map_shared (sector))
+        return true;
+      printf ("fsck: inode %"PRDSNu": sector %"PRDSNu" is used more "
+              "than once\n",
+              owner, sector);
+    }
+  else
+    {
+      bitmap_set_multiple (used, sector, cnt, true);
+      return true;
+    }
+  ++*errors;
+  return false;
+}
+
+/* Checks the block map of indirect block SECTOR, which holds
+   CNT data blocks at LEVEL levels of indirection.  Each block
+   map sector is read only once.  With HOLES, as in compressed
+   files, null data pointers are allowed. */
+static void
+check_indir (block_sector_t owner, block_sector_t sector, size_t cnt,
+             int level, bool holes, struct bitmap *used, size_t *errors)
+{
+  struct indir_inode *indir_block;
+  size_t chunk = level_span (level - 1);
+  size_t i, nmax;
+
+  if (!check_sector (owner, sector, 1, used, errors))
+    return;
+
+  /* On the heap, since this recurses once per level. */
+  indir_block = malloc (sizeof *indir_block);
+  if (indir_block == NULL || !buffer_cache_read_meta (sector, indir_block))
+    {
+      ++*errors;
+      free (indir_block);
+      return;
+    }
+  for (i = 0; cnt > 0; i++, cnt -= nmax)
+    {
+      nmax = cnt < chunk ? cnt : chunk;
+      if (level > 1)
+        check_indir (owner, indir_block->block[i], nmax, level - 1,
+                     holes, used, errors);
+      else if (!holes || indir_block->block[i] != 0)
+        check_sector (owner, indir_block->block[i], block_sectors,
+                      used, errors);
+    }
+  free (indir_block);
+}
+
+/* Walks every direct and indirect block of the
+   inode in SECTOR and marks them in USED; the caller marks SECTOR
+   itself.  Problems are reported and counted in *ERRORS.  Sets
+   *IS_DIR to whether the inode is a directory.  Returns false if
+   SECTOR does not hold an inode at all. */
+bool
+inode_check (block_sector_t sector, struct bitmap *used, bool *is_dir,
+             size_t *errors)
+{
+  static struct inode_disk disk;
+  size_t num_sec, max, i;
+  int level;
+
+  if (!buffer_cache_read_meta (sector, &disk))
+    ++*errors;
+  if (disk.magic != INODE_MAGIC || disk.length < 0)
+    {
+      printf ("fsck: sector %"PRDSNu" is not an inode\n", sector);
+      ++*errors;
+      return false;
+    }
+  *is_dir = disk.is_dir;
+
+  num_sec = map_blocks (&disk, disk.length);
+  if (num_sec > max_blocks ())
+    {
+      printf ("fsck: inode %"PRDSNu": length %"PROTd" is too large\n",
+              sector, disk.length);
+      ++*errors;
+      num_sec = max_blocks ();
+    }
+
+  max = num_sec < DIRECT ? num_sec : DIRECT;
+  for (i = 0; i < max; i++)
+    if (!disk.compressed || disk.dir_blocks[i] != 0)
+      check_sector (sector, disk.dir_blocks[i], block_sectors,
+                    used, errors);
+  num_sec -= max;
+
+  for (level = 1; num_sec > 0; level++)
+    {
+      max = num_sec < level_span (level) ? num_sec : level_span (level);
+      check_indir (sector, disk.indir_blocks[level - 1], max, level,
+                   disk.compressed, used, errors);
+      num_sec -= max;
+    }
+  return true;
+}
+
 bool inode_new(struct inode_disk *page)
 {
   return inode_reserve(page,page->length);
@@ -4,24 +4,35 @@
 #include <stdbool.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
-#define DIRECT 123
-#define INDIRECT 128
+#define DIRECT 121
+#define INDIRECT 127
+#define INDIR_LEVELS 3
 
 struct bitmap;
 
 void inode_init (void);
+void inode_set_block_size (unsigned sectors);
 bool inode_create (block_sector_t, off_t, bool);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
+unsigned inode_generation (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+void inode_reap (void);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+bool inode_extend (struct inode *, off_t length);
+off_t inode_copy (struct inode *dst, off_t dst_ofs, struct inode *src,
+                  off_t src_ofs, off_t size);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
 bool is_inode_dir (const struct inode *);
 bool is_inode_rm (const struct inode *);
+bool inode_set_compressed (struct inode *);
+size_t inode_dedup (struct inode *);
+bool inode_check (block_sector_t, struct bitmap *used, bool *is_dir,
+                  size_t *errors);
 
 #endif /* filesys/inode.h */
@@ -0,0 +1,225 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* On-disk journal header.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.  A header with
+   a nonzero CNT is the commit record for the CNT sector images
+   stored right after it; writing it is the commit point. */
+struct journal_header
+  {
+    unsigned magic;                     /* Magic number. */
+    uint32_t cnt;                       /* Number of logged sectors. */
+    uint32_t features;                  /* FS_* feature flags. */
+    block_sector_t sectors[JOURNAL_MAX]; /* Home of each logged image. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 12 - 4 * JOURNAL_MAX];
+  };
+
+static struct journal_header header;    /* Guarded by the cache lock. */
+static bool enabled;                    /* Journaling turned on? */
+static uint32_t features;               /* File system feature flags. */
+
+/* Running transaction.  Operations hold a handle on it between
+   journal_begin() and journal_end(); a commit only happens when
+   no handles are held, so it never contains half an operation.
+   Each handle reserves room for JOURNAL_OP_MAX sectors, so the
+   transaction can't outgrow the journal before its open
+   operations finish. */
+static struct lock journal_lock;
+static struct condition journal_idle;   /* Signaled when a handle closes. */
+static int active;                      /* Number of open handles. */
+static size_t reserved;                 /* Sectors reserved by them. */
+
+/* Initializes the journal module. */
+void
+journal_init (void)
+{
+  ASSERT (sizeof header == BLOCK_SECTOR_SIZE);
+  lock_init (&journal_lock);
+  cond_init (&journal_idle);
+  active = 0;
+  reserved = 0;
+  enabled = false;
+  features = 0;
+}
+
+/* Writes an empty journal to a freshly formatted file system
+   with the given FS_* FEATURES.  The journal header is
+   the one sector at a fixed place that is always rewritten
+   whole, so the feature flags are kept in it. */
+void
+journal_format (unsigned features_)
+{
+  features = features_;
+  journal_clear ();
+}
+
+/* Replays the committed transaction left in the journal, if
+   any, and turns journaling on.  Must run before anything is
+   read through the buffer cache. */
+void
+journal_recover (void)
+{
+  static uint8_t image[BLOCK_SECTOR_SIZE];
+  size_t i;
+
+  block_read (fs_device, JOURNAL_SECTOR, &header);
+  if (header.magic != JOURNAL_MAGIC || header.cnt > JOURNAL_MAX)
+    {
+      printf ("journal: no journal on file system, journaling disabled\n");
+      return;
+    }
+  features = header.features;
+  if (header.cnt > 0)
+    {
+      printf ("journal: replaying %"PRIu32" sectors\n", header.cnt);
+      for (i = 0; i < header.cnt; i++)
+        {
+          block_read (fs_device, JOURNAL_SECTOR + 1 + i, image);
+          block_write (fs_device, header.sectors[i], image);
+        }
+      journal_clear ();
+    }
+  enabled = true;
+}
+
+/* Returns true if metadata writes are being journaled. */
+bool
+journal_enabled (void)
+{
+  return enabled;
+}
+
+/* Returns the FS_* flags the file system was formatted with. */
+unsigned
+journal_features (void)
+{
+  return features;
+}
+
+/* Returns true if the running transaction has room for one more
+   operation: all it logged so far, the worst case of every open
+   handle, and JOURNAL_OP_MAX more.  Sectors an open operation has
+   already logged are counted twice, which errs on the safe
+   side. */
+static bool
+has_room (size_t journaled)
+{
+  return journaled + reserved + JOURNAL_OP_MAX <= JOURNAL_MAX;
+}
+
+/* Opens a handle on the running transaction for the current
+   thread, reserving room for JOURNAL_OP_MAX sectors.  Nested
+   calls are folded into the outermost one, so an operation,
+   nested ones included, must log no more than that; larger ones
+   are split into several.  If the transaction has grown past
+   JOURNAL_BATCH sectors or has no room left, waits for the other
+   handles to close and commits it first. */
+void
+journal_begin (void)
+{
+  struct thread *t = thread_current ();
+  size_t journaled;
+
+  if (!enabled || t->journal_depth++ > 0)
+    return;
+  lock_acquire (&journal_lock);
+  for (;;)
+    {
+      journaled = buffer_cache_journaled ();
+      if (journaled < JOURNAL_BATCH && has_room (journaled))
+        break;
+      if (active == 0)
+        buffer_cache_commit ();
+      else
+        cond_wait (&journal_idle, &journal_lock);
+    }
+  active++;
+  reserved += JOURNAL_OP_MAX;
+  lock_release (&journal_lock);
+}
+
+/* Closes the current thread's handle on the running transaction,
+   committing it if it is large enough and nobody else is inside
+   an operation. */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  if (!enabled || --t->journal_depth > 0)
+    return;
+  lock_acquire (&journal_lock);
+  reserved -= JOURNAL_OP_MAX;
+  if (--active == 0 && buffer_cache_journaled () >= JOURNAL_BATCH)
+    buffer_cache_commit ();
+  cond_broadcast (&journal_idle, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Returns true if the current thread holds a handle on the
+   running transaction. */
+bool
+journal_in_op (void)
+{
+  return thread_current ()->journal_depth > 0;
+}
+
+/* Waits until no operation holds a handle on the running
+   transaction and keeps new ones from starting until
+   journal_resume() is called.  The caller must not be inside an
+   operation itself. */
+void
+journal_pause (void)
+{
+  lock_acquire (&journal_lock);
+  while (active > 0)
+    cond_wait (&journal_idle, &journal_lock);
+}
+
+/* Lets operations start again after journal_pause(). */
+void
+journal_resume (void)
+{
+  lock_release (&journal_lock);
+}
+
+/* Logs CNT sector IMAGES, destined for SECTORS, and then writes
+   the header that commits them. */
+void
+journal_write (const block_sector_t *sectors, const void **images, size_t cnt)
+{
+  size_t i;
+
+  ASSERT (cnt <= JOURNAL_MAX);
+  for (i = 0; i < cnt; i++)
+    buffer_cache_write_home (JOURNAL_SECTOR + 1 + i, images[i]);
+
+  memset (&header, 0, sizeof header);
+  header.magic = JOURNAL_MAGIC;
+  header.features = features;
+  header.cnt = cnt;
+  memcpy (header.sectors, sectors, cnt * sizeof *sectors);
+  buffer_cache_write_home (JOURNAL_SECTOR, &header);
+}
+
+/* Marks the journal empty once its images have reached their
+   home sectors. */
+void
+journal_clear (void)
+{
+  memset (&header, 0, sizeof header);
+  header.magic = JOURNAL_MAGIC;
+  header.features = features;
+  buffer_cache_write_home (JOURNAL_SECTOR, &header);
+}
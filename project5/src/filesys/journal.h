@@ -0,0 +1,33 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Metadata journal.
+   The header lives in JOURNAL_SECTOR (see filesys.h) and is
+   followed by room for JOURNAL_MAX logged sector images. */
+#define JOURNAL_MAX 48                  /* Most sectors in one commit. */
+#define JOURNAL_BATCH 32                /* Commit once this many are dirty. */
+#define JOURNAL_OP_MAX 16               /* Most sectors one operation logs. */
+#define JOURNAL_SECTORS (1 + JOURNAL_MAX)
+
+void journal_init (void);
+void journal_format (unsigned features);
+void journal_recover (void);
+bool journal_enabled (void);
+unsigned journal_features (void);
+
+/* Transactions. */
+void journal_begin (void);
+void journal_end (void);
+bool journal_in_op (void);
+void journal_pause (void);
+void journal_resume (void);
+
+/* Used by the buffer cache to commit. */
+void journal_write (const block_sector_t *, const void **, size_t cnt);
+void journal_clear (void);
+
+#endif /* filesys/journal.h */
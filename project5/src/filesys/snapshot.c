@@ -0,0 +1,175 @@
+#include "filesys/snapshot.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* A read-only snapshot of the whole file system device.
+
+   Creating one only brings the disk to a consistent state; no
+   data is copied.  Afterward, the first time any sector is about
+   to be overwritten on disk, its old contents are copied to a
+   free sector and remembered here.  Reading the snapshot returns
+   the preserved copy of a sector if there is one and the sector
+   itself otherwise, so the image stays frozen while writers keep
+   going. */
+
+/* A sector preserved for the snapshot. */
+struct saved_sector
+  {
+    struct hash_elem elem;              /* Element in saved_sectors. */
+    block_sector_t sector;              /* Sector as of the snapshot. */
+    block_sector_t saved;               /* Where its contents live now. */
+  };
+
+static struct lock snapshot_lock;
+static struct hash saved_sectors;       /* Preserved sectors. */
+static bool active;                     /* Does a snapshot exist? */
+static bool broken;                     /* Ran out of space to preserve? */
+
+static hash_hash_func saved_hash;
+static hash_less_func saved_less;
+static hash_action_func saved_free;
+
+/* Initializes the snapshot module. */
+void
+snapshot_init (void)
+{
+  lock_init (&snapshot_lock);
+  hash_init (&saved_sectors, saved_hash, saved_less, NULL);
+  active = broken = false;
+}
+
+/* Takes a snapshot of the file system.  Waits for operations in
+   progress to finish, then commits the journal and writes every
+   dirty cached sector home, so that the disk holds a consistent
+   image.  Returns false if a snapshot already exists. */
+bool
+snapshot_create (void)
+{
+  bool success = false;
+
+  journal_pause ();
+  buffer_cache_flush_all ();
+  lock_acquire (&snapshot_lock);
+  if (!active)
+    {
+      active = true;
+      broken = false;
+      success = true;
+    }
+  lock_release (&snapshot_lock);
+  journal_resume ();
+  return success;
+}
+
+/* Reads SECTOR as it was when the snapshot was taken into
+   BUFFER.  Returns false if there is no usable snapshot or
+   SECTOR is out of range. */
+bool
+snapshot_read (block_sector_t sector, void *buffer)
+{
+  struct saved_sector key, *s;
+  struct hash_elem *e;
+  bool success = false;
+
+  lock_acquire (&snapshot_lock);
+  if (active && !broken && sector < block_size (fs_device))
+    {
+      key.sector = sector;
+      e = hash_find (&saved_sectors, &key.elem);
+      s = e != NULL ? hash_entry (e, struct saved_sector, elem) : NULL;
+      block_read (fs_device, s != NULL ? s->saved : sector, buffer);
+      success = true;
+    }
+  lock_release (&snapshot_lock);
+  return success;
+}
+
+/* Discards the snapshot and releases the sectors that held its
+   preserved data. */
+void
+snapshot_drop (void)
+{
+  journal_pause ();
+  lock_acquire (&snapshot_lock);
+  active = broken = false;
+  lock_release (&snapshot_lock);
+
+  /* Releasing writes the free map through the cache, which calls
+     snapshot_preserve(), so do it without holding the lock.  With
+     ACTIVE false nobody else touches SAVED_SECTORS, and pausing
+     the journal keeps snapshot_create() out. */
+  hash_clear (&saved_sectors, saved_free);
+  journal_resume ();
+}
+
+/* Called just before SECTOR is overwritten on disk, with the
+   buffer cache lock held.  If the snapshot still needs SECTOR's
+   current contents, copies them to a newly reserved sector,
+   stores that sector into *SAVED and returns true, so the caller
+   can drop any stale cached copy of it. */
+bool
+snapshot_preserve (block_sector_t sector, block_sector_t *saved)
+{
+  static uint8_t buffer[BLOCK_SECTOR_SIZE];
+  struct saved_sector key, *s = NULL;
+
+  lock_acquire (&snapshot_lock);
+  if (!active || broken)
+    goto done;
+  key.sector = sector;
+  if (hash_find (&saved_sectors, &key.elem) != NULL)
+    goto done;
+
+  s = malloc (sizeof *s);
+  if (s == NULL || !free_map_reserve (&s->saved))
+    {
+      printf ("snapshot: out of space, snapshot is no longer usable\n");
+      free (s);
+      s = NULL;
+      broken = true;
+      goto done;
+    }
+  s->sector = sector;
+  block_read (fs_device, sector, buffer);
+  block_write (fs_device, s->saved, buffer);
+  hash_insert (&saved_sectors, &s->elem);
+  *saved = s->saved;
+
+ done:
+  lock_release (&snapshot_lock);
+  return s != NULL;
+}
+
+/* Hashes a preserved sector by its original sector number. */
+static unsigned
+saved_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct saved_sector *s = hash_entry (e, struct saved_sector, elem);
+  return hash_bytes (&s->sector, sizeof s->sector);
+}
+
+/* Orders preserved sectors by their original sector number. */
+static bool
+saved_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct saved_sector *a = hash_entry (a_, struct saved_sector, elem);
+  const struct saved_sector *b = hash_entry (b_, struct saved_sector, elem);
+  return a->sector < b->sector;
+}
+
+/* Releases a preserved sector. */
+static void
+saved_free (struct hash_elem *e, void *aux UNUSED)
+{
+  struct saved_sector *s = hash_entry (e, struct saved_sector, elem);
+  free_map_release (s->saved, 1);
+  free (s);
+}
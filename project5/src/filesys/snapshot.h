@@ -0,0 +1,15 @@
+#ifndef FILESYS_SNAPSHOT_H
+#define FILESYS_SNAPSHOT_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+void snapshot_init (void);
+bool snapshot_create (void);
+bool snapshot_read (block_sector_t, void *);
+void snapshot_drop (void);
+
+/* Used by the buffer cache and journal before writing home. */
+bool snapshot_preserve (block_sector_t, block_sector_t *saved);
+
+#endif /* filesys/snapshot.h */
@@ -0,0 +1,61 @@
+#include "crc32c.h"
+#include <stdbool.h>
+
+/* Table-driven CRC, as in tests/cksum.c, but processing eight
+   bytes per step ("slicing-by-8").  tables[0] is the ordinary
+   byte-at-a-time table; tables[K][B] is the CRC of byte B
+   followed by K zero bytes, so that eight table lookups advance
+   the CRC over eight bytes at once.
+
+   The 8 kB of tables are computed on first use rather than
+   spelled out here.  Two threads racing to build them write
+   identical values, so no lock is needed. */
+static uint32_t tables[8][256];
+static bool tables_ready;
+
+static void
+build_tables (void)
+{
+  int i, j, k;
+
+  for (i = 0; i < 256; i++)
+    {
+      uint32_t c = i;
+      for (j = 0; j < 8; j++)
+        c = c & 1 ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+      tables[0][i] = c;
+    }
+  for (k = 1; k < 8; k++)
+    for (i = 0; i < 256; i++)
+      tables[k][i] = (tables[k - 1][i] >> 8)
+                     ^ tables[0][tables[k - 1][i] & 0xff];
+  tables_ready = true;
+}
+
+/* Returns the CRC-32C of the SIZE bytes in BUF, continuing from
+   CRC, the value returned for the preceding data (0 to start). */
+uint32_t
+crc32c (uint32_t crc, const void *buf_, size_t size)
+{
+  const uint8_t *buf = buf_;
+
+  if (!tables_ready)
+    build_tables ();
+
+  crc = ~crc;
+  for (; size > 0 && (uintptr_t) buf % 4 != 0; size--)
+    crc = tables[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+  for (; size >= 8; size -= 8, buf += 8)
+    {
+      /* Little-endian word loads, as on the 80x86. */
+      uint32_t lo = *(const uint32_t *) buf ^ crc;
+      uint32_t hi = *(const uint32_t *) (buf + 4);
+      crc = (tables[7][lo & 0xff] ^ tables[6][(lo >> 8) & 0xff]
+             ^ tables[5][(lo >> 16) & 0xff] ^ tables[4][lo >> 24]
+             ^ tables[3][hi & 0xff] ^ tables[2][(hi >> 8) & 0xff]
+             ^ tables[1][(hi >> 16) & 0xff] ^ tables[0][hi >> 24]);
+    }
+  for (; size > 0; size--)
+    crc = tables[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
@@ -0,0 +1,12 @@
+#ifndef __LIB_KERNEL_CRC32C_H
+#define __LIB_KERNEL_CRC32C_H
+
+/* CRC-32C (Castagnoli), the checksum used by iSCSI, ext4 and
+   btrfs metadata.  Its reflected polynomial is 0x82f63b78. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t crc32c (uint32_t crc, const void *, size_t);
+
+#endif /* lib/kernel/crc32c.h */
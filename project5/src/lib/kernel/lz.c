@@ -0,0 +1,199 @@
+#include "lz.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Matches are found through a hash table of the last position at
+   which each 4-byte sequence was seen, stored as 16-bit offsets
+   from the start of the input. */
+#define HASH_BITS 10
+#define MIN_MATCH 4
+
+/* As in LZ4, the last 5 bytes of input are always literals and
+   the last match starts at least 12 bytes before the end. */
+#define LAST_LITERALS 5
+#define MF_LIMIT 12
+
+static inline uint32_t
+read32 (const uint8_t *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return v;
+}
+
+static inline unsigned
+hash (uint32_t v)
+{
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Writes the extension bytes of a literal or match length of
+   which 15 has already been stored in a token. */
+static uint8_t *
+put_length (uint8_t *op, size_t len)
+{
+  for (; len >= 255; len -= 255)
+    *op++ = 255;
+  *op++ = len;
+  return op;
+}
+
+/* Writes the final, match-less sequence holding the literals from
+   ANCHOR to END into OP, which has room up to OEND.  Returns the
+   new end of the output, or a null pointer if it did not fit. */
+static uint8_t *
+put_last_literals (uint8_t *op, uint8_t *oend,
+                   const uint8_t *anchor, const uint8_t *end)
+{
+  size_t lit = end - anchor;
+
+  if ((size_t) (oend - op) < 1 + lit / 255 + 1 + lit)
+    return NULL;
+  *op++ = (lit >= 15 ? 15 : lit) << 4;
+  if (lit >= 15)
+    op = put_length (op, lit - 15);
+  memcpy (op, anchor, lit);
+  return op + lit;
+}
+
+/* Compresses the SIZE bytes in SRC, at most 64 kB, into DST.
+   WORK must point to LZ_WORK_SIZE bytes of scratch space.
+   Returns the compressed size, or 0 if it would exceed
+   DST_SIZE. */
+size_t
+lz_compress (const void *src_, size_t size, void *dst_, size_t dst_size,
+             void *work)
+{
+  const uint8_t *src = src_;
+  const uint8_t *ip = src, *anchor = src;
+  const uint8_t *end = src + size;
+  uint8_t *dst = dst_, *op = dst, *oend = dst + dst_size;
+  uint16_t *table = work;
+
+  ASSERT (size <= UINT16_MAX + 1);
+  ASSERT (sizeof *table << HASH_BITS == LZ_WORK_SIZE);
+
+  memset (table, 0, LZ_WORK_SIZE);
+  if (size > MF_LIMIT)
+    {
+      const uint8_t *mflimit = end - MF_LIMIT;
+      const uint8_t *matchlimit = end - LAST_LITERALS;
+
+      while (ip < mflimit)
+        {
+          uint32_t seq = read32 (ip);
+          unsigned h = hash (seq);
+          const uint8_t *ref = src + table[h];
+          const uint8_t *mp;
+          size_t lit, mlen, offset;
+          uint8_t *token;
+
+          table[h] = ip - src;
+          if (ref >= ip || read32 (ref) != seq)
+            {
+              ip++;
+              continue;
+            }
+
+          /* Extend the match backward over pending literals and
+             forward as far as allowed. */
+          while (ip > anchor && ref > src && ip[-1] == ref[-1])
+            {
+              ip--;
+              ref--;
+            }
+          offset = ip - ref;
+          for (mp = ip + MIN_MATCH; mp < matchlimit && *mp == mp[-offset];
+               mp++)
+            continue;
+
+          lit = ip - anchor;
+          mlen = mp - ip - MIN_MATCH;
+          if ((size_t) (oend - op)
+              < 1 + lit / 255 + 1 + lit + 2 + mlen / 255 + 1)
+            return 0;
+
+          token = op++;
+          *token = (lit >= 15 ? 15 : lit) << 4;
+          if (lit >= 15)
+            op = put_length (op, lit - 15);
+          memcpy (op, anchor, lit);
+          op += lit;
+          *op++ = offset & 0xff;
+          *op++ = offset >> 8;
+          *token |= mlen >= 15 ? 15 : mlen;
+          if (mlen >= 15)
+            op = put_length (op, mlen - 15);
+
+          ip = anchor = mp;
+        }
+    }
+
+  op = put_last_literals (op, oend, anchor, end);
+  return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Reads the extension bytes of a length from *IPP, which must not
+   pass IEND, and adds them to *LEN.  Returns false if the input
+   ends first. */
+static bool
+get_length (const uint8_t **ipp, const uint8_t *iend, size_t *len)
+{
+  uint8_t b;
+
+  do
+    {
+      if (*ipp >= iend)
+        return false;
+      b = *(*ipp)++;
+      *len += b;
+    }
+  while (b == 255);
+  return true;
+}
+
+/* Decompresses the SIZE bytes in SRC into DST, which has room for
+   DST_SIZE bytes.  Returns the decompressed size, or -1 if SRC is
+   corrupt or does not fit. */
+int
+lz_decompress (const void *src, size_t size, void *dst_, size_t dst_size)
+{
+  const uint8_t *ip = src, *iend = ip + size;
+  uint8_t *dst = dst_, *op = dst, *oend = dst + dst_size;
+
+  while (ip < iend)
+    {
+      uint8_t token = *ip++;
+      size_t lit = token >> 4, mlen = token & 15, offset;
+      const uint8_t *ref;
+
+      if (lit == 15 && !get_length (&ip, iend, &lit))
+        return -1;
+      if (lit > (size_t) (iend - ip) || lit > (size_t) (oend - op))
+        return -1;
+      memcpy (op, ip, lit);
+      op += lit;
+      ip += lit;
+      if (ip == iend)
+        break;
+
+      if (iend - ip < 2)
+        return -1;
+      offset = ip[0] | ip[1] << 8;
+      ip += 2;
+      if (offset == 0 || offset > (size_t) (op - dst))
+        return -1;
+      if (mlen == 15 && !get_length (&ip, iend, &mlen))
+        return -1;
+      mlen += MIN_MATCH;
+      if (mlen > (size_t) (oend - op))
+        return -1;
+
+      /* Byte by byte, since the copy may overlap its source. */
+      for (ref = op - offset; mlen > 0; mlen--)
+        *op++ = *ref++;
+    }
+  return op - dst;
+}
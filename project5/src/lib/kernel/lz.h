@@ -0,0 +1,18 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* Fast LZ77 compression, using the LZ4 block format: a series of
+   sequences, each a run of literal bytes followed by a copy of
+   at least 4 bytes from up to 64 kB back. */
+
+#include <stddef.h>
+
+/* Size of the scratch space lz_compress() needs. */
+#define LZ_WORK_SIZE 2048
+
+size_t lz_compress (const void *src, size_t size, void *dst,
+                    size_t dst_size, void *work);
+int lz_decompress (const void *src, size_t size, void *dst,
+                   size_t dst_size);
+
+#endif /* lib/kernel/lz.h */
@@ -20,8 +20,17 @@ enum
     SYS_CLOSE,                  /* Close a file. */
     SYS_FIBO,			/* execute fibonacci*/
     SYS_MAXFOUR,		/* return maximum among 4 integer*/
+    SYS_PREAD,                  /* Read from a file at an offset. */
+    SYS_PWRITE,                 /* Write to a file at an offset. */
+    SYS_READV,                  /* Read into several buffers. */
+    SYS_WRITEV,                 /* Write from several buffers. */
+    SYS_COPY_FILE_RANGE,        /* Copy data between two files. */
+    SYS_RING_SETUP,             /* Register a syscall ring. */
+    SYS_RING_ENTER,             /* Run the requests in the ring. */
+    SYS_SPAWN,                  /* Start a process from an argv. */
 
     /* Project 3 and optionally project 4. */
+    SYS_FORK,                   /* Duplicate the current process. */
     SYS_MMAP,                   /* Map a file into memory. */
     SYS_MUNMAP,                 /* Remove a memory mapping. */
 
@@ -30,7 +39,12 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+    SYS_RENAME,                 /* Moves a file or directory. */
+    SYS_SNAPSHOT,               /* Takes a file system snapshot. */
+    SYS_SNAPSHOT_READ,          /* Reads a sector of the snapshot. */
+    SYS_SNAPSHOT_DROP,          /* Discards the snapshot. */
+    SYS_COMPRESS                /* Stores a file compressed. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -159,6 +159,12 @@ close (int fd)
   syscall1 (SYS_CLOSE, fd);
 }
 
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
 mapid_t
 mmap (int fd, void *addr)
 {
@@ -200,6 +206,36 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+rename (const char *old, const char *new)
+{
+  return syscall2 (SYS_RENAME, old, new);
+}
+
+bool
+fs_snapshot (void)
+{
+  return syscall0 (SYS_SNAPSHOT);
+}
+
+bool
+fs_snapshot_read (unsigned sector, void *buffer)
+{
+  return syscall2 (SYS_SNAPSHOT_READ, sector, buffer);
+}
+
+void
+fs_snapshot_drop (void)
+{
+  syscall0 (SYS_SNAPSHOT_DROP);
+}
+
+bool
+compress (int fd)
+{
+  return syscall1 (SYS_COMPRESS, fd);
+}
 int 
 fibonacci(int n)
 {
@@ -210,3 +246,51 @@ max_of_four_int(int a,int b,int c,int d)
 {
 	return syscall4(SYS_MAXFOUR,a,b,c,d);
 }
+
+int
+pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PREAD, fd, buffer, size, offset);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PWRITE, fd, buffer, size, offset);
+}
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+copy_file_range (int fd_in, int fd_out, unsigned size)
+{
+  return syscall3 (SYS_COPY_FILE_RANGE, fd_in, fd_out, size);
+}
+
+bool
+ring_setup (struct sys_ring *ring)
+{
+  return syscall1 (SYS_RING_SETUP, ring);
+}
+
+int
+ring_enter (void)
+{
+  return syscall0 (SYS_RING_ENTER);
+}
+
+pid_t
+spawn (const char *file, char *const argv[], const int *fds, int fd_cnt)
+{
+  return (pid_t) syscall4 (SYS_SPAWN, file, argv, fds, fd_cnt);
+}
@@ -2,6 +2,7 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <debug.h>
 
 /* Process identifier. */
@@ -15,6 +16,59 @@ typedef int mapid_t;
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* One buffer of a readv() or writev() transfer. */
+struct iovec
+  {
+    void *iov_base;             /* Start of buffer. */
+    size_t iov_len;             /* Buffer size in bytes. */
+  };
+
+/* Most buffers in one readv() or writev() call. */
+#define IOV_MAX 64
+
+/* Syscall ring: the process queues requests in SQ and advances
+   SQ_TAIL, then ring_enter() runs every queued request in one
+   trap, advancing SQ_HEAD, and posts a completion for each in CQ
+   at CQ_TAIL.  The process consumes completions by advancing
+   CQ_HEAD.  Indexes run freely and are taken modulo RING_ENTRIES. */
+#define RING_ENTRIES 32
+
+/* Operations in a syscall ring request. */
+enum ring_op
+  {
+    RING_READ,                  /* read (fd, buf, size). */
+    RING_WRITE,                 /* write (fd, buf, size). */
+    RING_PREAD,                 /* pread (fd, buf, size, offset). */
+    RING_OPEN,                  /* open (buf), BUF being a file name. */
+    RING_CLOSE                  /* close (fd); -1 if FD is not open. */
+  };
+
+/* A request queued in a syscall ring. */
+struct ring_sqe
+  {
+    int op;                     /* One of enum ring_op. */
+    int fd;
+    void *buf;
+    unsigned size;
+    unsigned offset;
+    unsigned user_data;         /* Copied into the completion. */
+  };
+
+/* The completion of a syscall ring request. */
+struct ring_cqe
+  {
+    int res;                    /* What the system call returned. */
+    unsigned user_data;         /* From the request. */
+  };
+
+struct sys_ring
+  {
+    unsigned sq_head, sq_tail;
+    struct ring_sqe sq[RING_ENTRIES];
+    unsigned cq_head, cq_tail;
+    struct ring_cqe cq[RING_ENTRIES];
+  };
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -35,7 +89,16 @@ unsigned tell (int fd);
 void close (int fd);
 int fibonacci(int n);
 int max_of_four_int(int a,int b,int c,int d);
+int pread (int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned offset);
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int copy_file_range (int fd_in, int fd_out, unsigned length);
+bool ring_setup (struct sys_ring *);
+int ring_enter (void);
+pid_t spawn (const char *file, char *const argv[], const int *fds, int fd_cnt);
 /* Project 3 and optionally project 4. */
+pid_t fork (void);
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t);
 
@@ -45,5 +108,10 @@ bool mkdir (const char *dir);
 bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
+bool rename (const char *old, const char *new);
+bool fs_snapshot (void);
+bool fs_snapshot_read (unsigned sector, void *buffer);
+void fs_snapshot_drop (void);
+bool compress (int fd);
 
 #endif /* lib/user/syscall.h */
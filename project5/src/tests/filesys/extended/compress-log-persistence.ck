@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($log) = join ('', map ("log line $_: all quiet\n", 0...999));
+substr ($log, 5000, 11) = "OVERWRITTEN";
+check_archive ({"log" => [$log], "raw" => ["\0" x 10]});
+pass;
@@ -0,0 +1,52 @@
+/* Writes a highly compressible log to a compressed file, a few
+   hundred bytes at a time, overwrites part of it in the middle,
+   and reads it back.  Also checks that a file that already has
+   data can't be switched to compression. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define LINES 1000
+#define CHUNK 700
+
+static char buf[32768];
+
+void
+test_main (void)
+{
+  size_t size = 0, ofs;
+  int fd, i;
+
+  for (i = 0; i < LINES; i++)
+    size += snprintf (buf + size, sizeof buf - size,
+                      "log line %d: all quiet\n", i);
+
+  CHECK (create ("log", 0), "create \"log\"");
+  CHECK ((fd = open ("log")) > 1, "open \"log\"");
+  CHECK (compress (fd), "compress \"log\"");
+  msg ("write \"log\"");
+  for (ofs = 0; ofs < size; ofs += CHUNK)
+    {
+      size_t block_size = size - ofs < CHUNK ? size - ofs : CHUNK;
+      if (write (fd, buf + ofs, block_size) != (int) block_size)
+        fail ("write %zu bytes at offset %zu in \"log\" failed",
+              block_size, ofs);
+    }
+
+  memcpy (buf + 5000, "OVERWRITTEN", 11);
+  msg ("overwrite \"log\"");
+  seek (fd, 5000);
+  CHECK (write (fd, buf + 5000, 11) == 11, "write \"log\"");
+  msg ("close \"log\"");
+  close (fd);
+  check_file ("log", buf, size);
+
+  CHECK (create ("raw", 10), "create \"raw\"");
+  CHECK ((fd = open ("raw")) > 1, "open \"raw\"");
+  CHECK (!compress (fd), "compress \"raw\" (must fail)");
+  msg ("close \"raw\"");
+  close (fd);
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(compress-log) begin
+(compress-log) create "log"
+(compress-log) open "log"
+(compress-log) compress "log"
+(compress-log) write "log"
+(compress-log) overwrite "log"
+(compress-log) write "log"
+(compress-log) close "log"
+(compress-log) open "log" for verification
+(compress-log) verified contents of "log"
+(compress-log) close "log"
+(compress-log) create "raw"
+(compress-log) open "raw"
+(compress-log) compress "raw" (must fail)
+(compress-log) close "raw"
+(compress-log) end
+EOF
+pass;
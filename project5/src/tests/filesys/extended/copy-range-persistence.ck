@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($src) = join ('', map (chr (ord ('a') + $_ % 26), 0...1999));
+check_archive ({"src" => [$src], "dst" => [substr ($src, 100)]});
+pass;
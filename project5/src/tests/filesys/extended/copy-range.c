@@ -0,0 +1,44 @@
+/* Copies part of one file into another with copy_file_range,
+   starting in the middle of the source, and checks the result
+   and both file positions. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE 2000
+#define START 100
+#define COPY 1500
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  int in_fd, out_fd, i;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = 'a' + i % 26;
+
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK ((in_fd = open ("src")) > 1, "open \"src\"");
+  CHECK (write (in_fd, buf, SIZE) == SIZE, "write \"src\"");
+  CHECK (create ("dst", 0), "create \"dst\"");
+  CHECK ((out_fd = open ("dst")) > 1, "open \"dst\"");
+
+  seek (in_fd, START);
+  CHECK (copy_file_range (in_fd, out_fd, COPY) == COPY,
+         "copy_file_range \"src\" to \"dst\"");
+  CHECK (tell (in_fd) == START + COPY, "tell \"src\"");
+  CHECK (tell (out_fd) == COPY, "tell \"dst\"");
+  CHECK (copy_file_range (in_fd, out_fd, COPY) == SIZE - START - COPY,
+         "copy_file_range to end of \"src\"");
+  CHECK (copy_file_range (in_fd, out_fd, 1) == 0,
+         "copy_file_range at end of \"src\"");
+
+  msg ("close \"src\"");
+  close (in_fd);
+  msg ("close \"dst\"");
+  close (out_fd);
+  check_file ("dst", buf + START, SIZE - START);
+}
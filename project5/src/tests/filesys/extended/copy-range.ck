@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(copy-range) begin
+(copy-range) create "src"
+(copy-range) open "src"
+(copy-range) write "src"
+(copy-range) create "dst"
+(copy-range) open "dst"
+(copy-range) copy_file_range "src" to "dst"
+(copy-range) tell "src"
+(copy-range) tell "dst"
+(copy-range) copy_file_range to end of "src"
+(copy-range) copy_file_range at end of "src"
+(copy-range) close "src"
+(copy-range) close "dst"
+(copy-range) open "dst" for verification
+(copy-range) verified contents of "dst"
+(copy-range) close "dst"
+(copy-range) end
+EOF
+pass;
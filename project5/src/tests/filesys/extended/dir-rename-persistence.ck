@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"b" => {}, "h" => ["rename keeps the same inode\0"]});
+pass;
@@ -0,0 +1,44 @@
+/* Moves a file and a directory between directories with rename,
+   replaces an existing file, and verifies that a directory can't
+   be moved underneath itself. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char data[] = "rename keeps the same inode";
+
+void
+test_main (void) 
+{
+  int fd, inum;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (create ("a/f", 0), "create \"a/f\"");
+  CHECK ((fd = open ("a/f")) > 1, "open \"a/f\"");
+  CHECK (write (fd, data, sizeof data) == sizeof data, "write \"a/f\"");
+  inum = inumber (fd);
+  msg ("close \"a/f\"");
+  close (fd);
+
+  CHECK (rename ("a/f", "g"), "rename \"a/f\" to \"g\"");
+  CHECK (open ("a/f") == -1, "open \"a/f\" (must fail)");
+  CHECK ((fd = open ("g")) > 1, "open \"g\"");
+  CHECK (inumber (fd) == inum, "verify \"g\" kept its inumber");
+  msg ("close \"g\"");
+  close (fd);
+
+  CHECK (mkdir ("a/b"), "mkdir \"a/b\"");
+  CHECK (!rename ("a", "a/b/c"), "rename \"a\" to \"a/b/c\" (must fail)");
+  CHECK (rename ("a/b", "b"), "rename \"a/b\" to \"b\"");
+  CHECK (chdir ("b"), "chdir \"b\"");
+  CHECK (chdir (".."), "chdir \"..\"");
+  CHECK (remove ("a"), "remove \"a\"");
+
+  CHECK (create ("h", 512), "create \"h\"");
+  CHECK (!rename ("h", "b"), "rename \"h\" to \"b\" (must fail)");
+  CHECK (rename ("g", "h"), "rename \"g\" to \"h\"");
+  CHECK (open ("g") == -1, "open \"g\" (must fail)");
+  check_file ("h", data, sizeof data);
+}
@@ -0,0 +1,32 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-rename) begin
+(dir-rename) mkdir "a"
+(dir-rename) create "a/f"
+(dir-rename) open "a/f"
+(dir-rename) write "a/f"
+(dir-rename) close "a/f"
+(dir-rename) rename "a/f" to "g"
+(dir-rename) open "a/f" (must fail)
+(dir-rename) open "g"
+(dir-rename) verify "g" kept its inumber
+(dir-rename) close "g"
+(dir-rename) mkdir "a/b"
+(dir-rename) rename "a" to "a/b/c" (must fail)
+(dir-rename) rename "a/b" to "b"
+(dir-rename) chdir "b"
+(dir-rename) chdir ".."
+(dir-rename) remove "a"
+(dir-rename) create "h"
+(dir-rename) rename "h" to "b" (must fail)
+(dir-rename) rename "g" to "h"
+(dir-rename) open "g" (must fail)
+(dir-rename) open "h" for verification
+(dir-rename) verified contents of "h"
+(dir-rename) close "h"
+(dir-rename) end
+EOF
+pass;
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($db) = "record one" . ("\0" x 2990) . "record two";
+check_archive ({"db" => [$db]});
+pass;
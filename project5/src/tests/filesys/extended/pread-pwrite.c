@@ -0,0 +1,37 @@
+/* Writes two records with pwrite, the second past the end of
+   the file, reads them back with pread, and checks that neither
+   call moved the file position. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[3010];
+
+void
+test_main (void)
+{
+  char got[10];
+  int fd;
+
+  memcpy (buf, "record one", 10);
+  memcpy (buf + 3000, "record two", 10);
+
+  CHECK (create ("db", 0), "create \"db\"");
+  CHECK ((fd = open ("db")) > 1, "open \"db\"");
+  CHECK (pwrite (fd, buf + 3000, 10, 3000) == 10, "pwrite \"db\" at 3000");
+  CHECK (pwrite (fd, buf, 10, 0) == 10, "pwrite \"db\" at 0");
+  CHECK (tell (fd) == 0, "tell \"db\" after pwrite");
+  CHECK (pread (fd, got, 10, 3000) == 10, "pread \"db\" at 3000");
+  if (memcmp (got, buf + 3000, 10))
+    fail ("pread at 3000 returned wrong data");
+  CHECK (pread (fd, got, 10, 5000) == 0, "pread \"db\" past end");
+  CHECK (tell (fd) == 0, "tell \"db\" after pread");
+  CHECK (read (fd, got, 10) == 10, "read \"db\"");
+  if (memcmp (got, buf, 10))
+    fail ("read returned wrong data");
+  msg ("close \"db\"");
+  close (fd);
+  check_file ("db", buf, sizeof buf);
+}
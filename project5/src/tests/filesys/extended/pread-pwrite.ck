@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) create "db"
+(pread-pwrite) open "db"
+(pread-pwrite) pwrite "db" at 3000
+(pread-pwrite) pwrite "db" at 0
+(pread-pwrite) tell "db" after pwrite
+(pread-pwrite) pread "db" at 3000
+(pread-pwrite) pread "db" past end
+(pread-pwrite) tell "db" after pread
+(pread-pwrite) read "db"
+(pread-pwrite) close "db"
+(pread-pwrite) open "db" for verification
+(pread-pwrite) verified contents of "db"
+(pread-pwrite) close "db"
+(pread-pwrite) end
+EOF
+pass;
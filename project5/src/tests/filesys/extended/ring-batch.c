@@ -0,0 +1,64 @@
+/* Queues writes, a positioned read, an open and closes in a
+   syscall ring, runs them all with one ring_enter(), and checks
+   the completions and the file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static struct sys_ring ring;
+
+static void
+submit (int op, int fd, void *buf, unsigned size, unsigned offset)
+{
+  struct ring_sqe *sqe = &ring.sq[ring.sq_tail % RING_ENTRIES];
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->buf = buf;
+  sqe->size = size;
+  sqe->offset = offset;
+  sqe->user_data = ring.sq_tail;
+  ring.sq_tail++;
+}
+
+void
+test_main (void)
+{
+  char got[10];
+  struct ring_cqe *cqe;
+  int fd, i;
+
+  CHECK (create ("batch", 0), "create \"batch\"");
+  CHECK ((fd = open ("batch")) > 1, "open \"batch\"");
+  CHECK (ring_setup (&ring), "ring_setup");
+
+  submit (RING_WRITE, fd, "hello ", 6, 0);
+  submit (RING_WRITE, fd, "ring", 4, 0);
+  submit (RING_PREAD, fd, got, 10, 0);
+  submit (RING_OPEN, 0, "batch", 0, 0);
+  submit (RING_CLOSE, fd, NULL, 0, 0);
+  submit (RING_CLOSE, fd, NULL, 0, 0);
+  CHECK (ring_enter () == 6, "ring_enter");
+  CHECK (ring.cq_tail == 6, "6 completions");
+
+  for (i = 0; i < 6; i++)
+    if (ring.cq[i].user_data != (unsigned) i)
+      fail ("completion %d is for request %u", i, ring.cq[i].user_data);
+  cqe = ring.cq;
+  if (cqe[0].res != 6 || cqe[1].res != 4 || cqe[2].res != 10)
+    fail ("transfers returned %d, %d, %d", cqe[0].res, cqe[1].res,
+          cqe[2].res);
+  if (memcmp (got, "hello ring", 10))
+    fail ("pread returned wrong data");
+  if (cqe[3].res < 2 || cqe[4].res != 0 || cqe[5].res != -1)
+    fail ("open and closes returned %d, %d, %d", cqe[3].res, cqe[4].res,
+          cqe[5].res);
+  msg ("completions ok");
+
+  ring.cq_head = ring.cq_tail;
+  CHECK (ring_enter () == 0, "ring_enter with nothing queued");
+  msg ("close \"batch\"");
+  close (cqe[3].res);
+  check_file ("batch", "hello ring", 10);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(ring-batch) begin
+(ring-batch) create "batch"
+(ring-batch) open "batch"
+(ring-batch) ring_setup
+(ring-batch) ring_enter
+(ring-batch) 6 completions
+(ring-batch) completions ok
+(ring-batch) ring_enter with nothing queued
+(ring-batch) close "batch"
+(ring-batch) open "batch" for verification
+(ring-batch) verified contents of "batch"
+(ring-batch) close "batch"
+(ring-batch) end
+EOF
+pass;
@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"log" => ["[log] writev ok\n" x 20]});
+pass;
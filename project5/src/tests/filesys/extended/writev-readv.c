@@ -0,0 +1,59 @@
+/* Writes log records made of a header, a payload and a newline
+   with writev, then reads the file back with readv into buffers
+   that split it at different places. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define RECORDS 20
+
+static char expected[RECORDS * 20];
+static char first[100], second[sizeof expected];
+
+void
+test_main (void)
+{
+  static const char header[] = "[log] ";
+  static const char payload[] = "writev ok";
+  struct iovec iov[3];
+  size_t rec_size = strlen (header) + strlen (payload) + 1;
+  size_t size = RECORDS * rec_size;
+  int fd, i;
+
+  for (i = 0; i < RECORDS; i++)
+    {
+      memcpy (expected + i * rec_size, header, strlen (header));
+      memcpy (expected + i * rec_size + strlen (header), payload,
+              strlen (payload));
+      expected[(i + 1) * rec_size - 1] = '\n';
+    }
+
+  CHECK (create ("log", 0), "create \"log\"");
+  CHECK ((fd = open ("log")) > 1, "open \"log\"");
+  iov[0].iov_base = (char *) header;
+  iov[0].iov_len = strlen (header);
+  iov[1].iov_base = (char *) payload;
+  iov[1].iov_len = strlen (payload);
+  iov[2].iov_base = "\n";
+  iov[2].iov_len = 1;
+  msg ("writev \"log\"");
+  for (i = 0; i < RECORDS; i++)
+    if (writev (fd, iov, 3) != (int) rec_size)
+      fail ("writev of record %d failed", i);
+  CHECK (tell (fd) == (unsigned) size, "tell \"log\"");
+
+  seek (fd, 0);
+  iov[0].iov_base = first;
+  iov[0].iov_len = sizeof first;
+  iov[1].iov_base = second;
+  iov[1].iov_len = sizeof second;
+  CHECK (readv (fd, iov, 2) == (int) size, "readv \"log\"");
+  if (memcmp (first, expected, sizeof first)
+      || memcmp (second, expected + sizeof first, size - sizeof first))
+    fail ("readv returned wrong data");
+  msg ("close \"log\"");
+  close (fd);
+  check_file ("log", expected, size);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(writev-readv) begin
+(writev-readv) create "log"
+(writev-readv) open "log"
+(writev-readv) writev "log"
+(writev-readv) tell "log"
+(writev-readv) readv "log"
+(writev-readv) close "log"
+(writev-readv) open "log" for verification
+(writev-readv) verified contents of "log"
+(writev-readv) close "log"
+(writev-readv) end
+EOF
+pass;
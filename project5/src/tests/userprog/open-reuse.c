@@ -0,0 +1,31 @@
+/* Opens the same file more times than fit in a process's first
+   fd table, closes one of the descriptors, and checks that the
+   next open reuses it, since the lowest free number is taken. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define HANDLES 40
+
+void
+test_main (void) 
+{
+  int handles[HANDLES];
+  int i, h;
+
+  for (i = 0; i < HANDLES; i++)
+    if ((handles[i] = open ("sample.txt")) < 2)
+      fail ("open \"sample.txt\" #%d failed", i);
+  for (i = 1; i < HANDLES; i++)
+    if (handles[i] == handles[i - 1])
+      fail ("open() returned %d twice", handles[i]);
+  msg ("open \"sample.txt\" %d times", HANDLES);
+
+  msg ("close \"sample.txt\" #%d", HANDLES / 2);
+  close (handles[HANDLES / 2]);
+  CHECK ((h = open ("sample.txt")) > 1, "open \"sample.txt\" again");
+  if (h != handles[HANDLES / 2])
+    fail ("open() returned %d instead of freed %d",
+          h, handles[HANDLES / 2]);
+}
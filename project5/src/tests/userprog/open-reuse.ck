@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(open-reuse) begin
+(open-reuse) open "sample.txt" 40 times
+(open-reuse) close "sample.txt" #20
+(open-reuse) open "sample.txt" again
+(open-reuse) end
+open-reuse: exit(0)
+EOF
+pass;
@@ -0,0 +1,18 @@
+/* Spawns a child from an argv array, including an argument with
+   a space in it that exec() would have split, and checks that
+   spawning a missing program fails at once. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char *argv[] = {"child-args", "two words", "x", NULL};
+  char *missing[] = {"no-such-file", NULL};
+
+  wait (spawn ("child-args", argv, NULL, 0));
+  CHECK (spawn ("no-such-file", missing, NULL, 0) == -1,
+         "spawn missing program");
+}
@@ -0,0 +1,51 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF', <<'EOF', <<'EOF']);
+(spawn-args) begin
+(args) begin
+(args) argc = 3
+(args) argv[0] = 'child-args'
+(args) argv[1] = 'two words'
+(args) argv[2] = 'x'
+(args) argv[3] = null
+(args) end
+child-args: exit(0)
+load: no-such-file: open failed
+no-such-file: exit(-1)
+(spawn-args) spawn missing program
+(spawn-args) end
+spawn-args: exit(0)
+EOF
+(spawn-args) begin
+(args) begin
+(args) argc = 3
+(args) argv[0] = 'child-args'
+(args) argv[1] = 'two words'
+(args) argv[2] = 'x'
+(args) argv[3] = null
+(args) end
+child-args: exit(0)
+load: no-such-file: open failed
+(spawn-args) spawn missing program
+no-such-file: exit(-1)
+(spawn-args) end
+spawn-args: exit(0)
+EOF
+(spawn-args) begin
+(args) begin
+(args) argc = 3
+(args) argv[0] = 'child-args'
+(args) argv[1] = 'two words'
+(args) argv[2] = 'x'
+(args) argv[3] = null
+(args) end
+child-args: exit(0)
+load: no-such-file: open failed
+(spawn-args) spawn missing program
+(spawn-args) end
+no-such-file: exit(-1)
+spawn-args: exit(0)
+EOF
+pass;
@@ -0,0 +1,34 @@
+/* Forks a child that checks and then overwrites a buffer the
+   parent filled, and verifies that the parent's copy is
+   unchanged afterward. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[65536];
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t i;
+
+  memset (buf, 'p', sizeof buf);
+  child = fork ();
+  if (child == 0)
+    {
+      for (i = 0; i < sizeof buf; i++)
+        if (buf[i] != 'p')
+          exit (1);
+      memset (buf, 'c', sizeof buf);
+      exit (42);
+    }
+  CHECK (child > 0, "fork");
+  CHECK (wait (child) == 42, "wait for child (should return 42)");
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 'p')
+      fail ("parent's buffer changed at byte %zu", i);
+  msg ("parent's buffer intact");
+}
@@ -37,6 +37,10 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/swap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
@@ -45,6 +49,10 @@ uint32_t *init_page_dir;
 /* -f: Format the file system? */
 static bool format_filesys;
 
+/* -cksum, -dedup, -blocksize: Features of a newly formatted file
+   system. */
+static unsigned format_features;
+
 /* -filesys, -scratch, -swap: Names of block devices to use,
    overriding the defaults. */
 static const char *filesys_bdev_name;
@@ -113,6 +121,7 @@ main (void)
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  process_init ();
 #endif
 
   /* Start thread scheduler and enable interrupts. */
@@ -124,7 +133,11 @@ main (void)
   /* Initialize file system. */
   ide_init ();
   locate_block_devices ();
-  filesys_init (format_filesys);
+  filesys_init (format_filesys, format_features);
+#endif
+#ifdef VM
+  frame_init (palloc_user_pages ());
+  swap_init ();
 #endif
 
   printf ("Boot complete.\n");
@@ -243,6 +256,21 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-cksum"))
+        format_features |= FS_CKSUM;
+      else if (!strcmp (name, "-dedup"))
+        format_features |= FS_DEDUP;
+      else if (!strcmp (name, "-blocksize"))
+        {
+          int sectors = value != NULL ? atoi (value) / BLOCK_SECTOR_SIZE : 0;
+          unsigned shift = 0;
+
+          while ((1 << shift) < sectors)
+            shift++;
+          if (sectors < 1 || sectors > 8 || 1 << shift != sectors)
+            PANIC ("-blocksize must be 512, 1024, 2048 or 4096");
+          format_features |= shift << FS_BLOCK_SHIFT;
+        }
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
@@ -320,6 +348,9 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"fsck", 1, fsutil_fsck},
+      {"fsck-repair", 1, fsutil_fsck},
+      {"dedup", 1, fsutil_dedup},
 #endif
       {NULL, 0, NULL},
     };
@@ -366,6 +397,9 @@ usage (void)
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  fsck               Check file system consistency.\n"
+          "  fsck-repair        Check file system and repair what it can.\n"
+          "  dedup              Share identical data sectors among files.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
@@ -376,6 +410,9 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -cksum             With -f, checksum file system metadata.\n"
+          "  -dedup             With -f, share identical data sectors.\n"
+          "  -blocksize=BYTES   With -f, allocate file data in blocks of BYTES.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
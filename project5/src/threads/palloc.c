@@ -61,6 +61,13 @@ palloc_init (size_t user_page_limit)
              user_pages, "user pool");
 }
 
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_pages (void)
+{
+  return bitmap_size (user_pool.used_map);
+}
+
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
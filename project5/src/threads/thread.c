@@ -641,6 +641,8 @@ init_thread (struct thread *t, const char *name, int priority)
   t->magic = THREAD_MAGIC;
   /*Used for stack growth*/
   t->current_stack = PGSIZE;
+  t->user_esp = NULL;
+  t->probing = false;
   old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
   intr_set_level (old_level);
@@ -649,20 +651,26 @@ init_thread (struct thread *t, const char *name, int priority)
   t->next_fd = 2;
   list_init (&t->openfiles);
 #ifdef USERPROG
-  	list_init(&(t->childs));
-	list_push_back(&(running_thread()->childs),&(t->element));
-	sema_init(&(t->pblock),0);
-	sema_init(&(t->defer_block),0);
+	t->children = NULL;
+	t->as_child = NULL;
 	/*--belows are pj2*/
     	/*it stated in manual 35pg. that maximum file num = 128*/
 	sema_init(&(t->wait_load),0);
 	t->p = running_thread();
-  	list_init(&t->fd_head);
+	t->fds = NULL;
+	t->fd_cap = 0;
+	t->fd_used = NULL;
+	t->ring = NULL;
 #else	
 	/* Project #3 */
 	t->recent_cpu = running_thread()->recent_cpu;
 	t->nice = running_thread()->nice;
 #endif
+#ifdef VM
+	list_init(&t->mmaps);
+	t->next_mapid = 0;
+	t->exec_file = NULL;
+#endif
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
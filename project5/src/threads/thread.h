@@ -111,22 +111,28 @@ struct thread
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;      /* Page directory. */
 
-    struct list childs;	//doubley linked list from lib/kernel/list.c
-    struct list_elem element;	//save threads' childs
-
-    struct semaphore pblock; //wait for child threads
-    struct semaphore defer_block; //defer block child to memory remove 
+    struct hash *children;    /* Child records by tid, or null. */
+    struct child *as_child;   /* Own record, held by the parent. */
     int exit_number;
     /*-------belows are project 2----------*/
-    struct file* Fd[129]; /*filesys/file.c -> it stated in manual 35pg. that maximum file num = 128*/
     struct thread* p;
     struct semaphore wait_load;
-    int is_load;
-    struct list fd_head;      
+    struct Fd **fds;          /* Open files, indexed by fd number. */
+    int fd_cap;               /* Number of slots in FDS. */
+    struct bitmap *fd_used;   /* Fd numbers in use, incl. 0 to 2. */
+    struct sys_ring *ring;    /* Syscall ring in user memory, or null. */
+#endif
+#ifdef VM
+    struct list mmaps;        /* Live mmap() regions (struct mapping). */
+    int next_mapid;           /* Id for the next mapping. */
+    struct file *exec_file;   /* Executable that code pages load from. */
 #endif
     /*Used for stack growth*/
     uint32_t current_stack;
+    void *user_esp;           /* User esp at syscall entry. */
+    bool probing;             /* In get_user() or put_user()? */
     struct dir *cwd;
+    int journal_depth;                  /* Nested journal_begin() calls. */
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
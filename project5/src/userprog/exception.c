@@ -173,13 +173,29 @@ uint8_t *newpage;  // new page for stack growth
   
   struct thread *cur = thread_current ();
   void *page,*dpage;
+  /* The frame of a fault in the kernel holds no user esp. */
+  void *esp = user ? f->esp : cur->user_esp;
   page = dpage = pg_round_down (fault_addr);
 
-  if (!not_present || !is_user_vaddr (fault_addr))
+  if (!is_user_vaddr (fault_addr))
       exit (-1);
 
-  if (fault_addr < PHYS_BASE-cur->current_stack  && fault_addr >= PHYS_BASE - PGSIZE * 20)
-     if(f->esp - 32 <= fault_addr)
+#ifdef VM
+  /* Pages in the supplemental page table are read in on first
+     touch, from the user or from a get_user() probe.  A write to
+     a page shared copy-on-write after fork() copies it. */
+  {
+    struct page *p = page_lookup (fault_addr);
+    if (p != NULL && not_present && page_load (p))
+      return;
+    if (p != NULL && !not_present && write && p->writable
+        && frame_unshare (p))
+      return;
+  }
+#endif
+
+  if (not_present && fault_addr < PHYS_BASE-cur->current_stack  && fault_addr >= PHYS_BASE - PGSIZE * 20)
+     if(esp - 32 <= fault_addr)
   	{
 
             while(page < PHYS_BASE - cur->current_stack)
@@ -195,6 +211,19 @@ uint8_t *newpage;  // new page for stack growth
             return;
       }
 
+  /* The kernel probes user memory with get_user() and put_user()
+     in userprog/syscall.c before using it.  They mark the thread
+     as probing and leave the address to resume at in EAX; make
+     the probe fail with -1 there.  Any other kernel fault is a
+     kernel bug, fatal unless there is a process to blame. */
+  if (!user && cur->probing)
+    {
+      f->eip = (void (*) (void)) f->eax;
+      f->eax = 0xffffffff;
+      return;
+    }
+  if (!user && cur->pagedir == NULL)
+    PANIC ("Kernel page fault at %p in %s", fault_addr, cur->name);
   exit(-1);
 
 
@@ -1,4 +1,5 @@
 #include "userprog/process.h"
+#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
 #include <round.h>
@@ -12,16 +13,124 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 static bool makeup_stack(void** esp,const char* file_name);
+
+/* A child process as its parent sees it.  The parent and the
+   child each hold a reference and whichever lets go last frees
+   it, so an exiting child's thread does not wait for its parent. */
+struct child
+  {
+    struct hash_elem elem;      /* In the parent's children. */
+    tid_t tid;                  /* Child's thread id. */
+    int load_status;            /* 1 loaded, -1 failed, 0 not yet. */
+    int exit_status;            /* Set when EXITED is upped. */
+    struct semaphore exited;    /* Upped when the child exits. */
+    int refs;                   /* Parent and/or child. */
+  };
+
+static unsigned
+child_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct child, elem)->tid);
+}
+
+static bool
+child_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct child, elem)->tid
+          < hash_entry (b, struct child, elem)->tid);
+}
+
+/* Returns a new child record referenced by both sides, or a null
+   pointer if out of memory. */
+static struct child *
+child_new (void)
+{
+  struct child *c = malloc (sizeof *c);
+  if (c != NULL)
+    {
+      c->tid = TID_ERROR;
+      c->load_status = 0;
+      c->exit_status = -1;
+      sema_init (&c->exited, 0);
+      c->refs = 2;
+    }
+  return c;
+}
+
+/* Drops one reference to C, freeing it with the last. */
+static void
+child_release (struct child *c)
+{
+  enum intr_level old_level = intr_disable ();
+  bool last = --c->refs == 0;
+  intr_set_level (old_level);
+  if (last)
+    free (c);
+}
+
+static void
+child_destroy (struct hash_elem *e, void *aux UNUSED)
+{
+  child_release (hash_entry (e, struct child, elem));
+}
+
+/* Enters C, the record of new thread TID, in the current
+   thread's children.  Returns false if out of memory. */
+static bool
+child_add (struct child *c, tid_t tid)
+{
+  struct thread *cur = thread_current ();
+  if (cur->children == NULL)
+    {
+      cur->children = malloc (sizeof *cur->children);
+      if (cur->children == NULL)
+        return false;
+      hash_init (cur->children, child_hash, child_less, NULL);
+    }
+  c->tid = tid;
+  hash_insert (cur->children, &c->elem);
+  return true;
+}
+
+/* Returns the current thread's record of child TID, or a null
+   pointer if TID is not its child. */
+static struct child *
+child_lookup (tid_t tid)
+{
+  struct thread *cur = thread_current ();
+  struct child key;
+  struct hash_elem *e;
+  if (cur->children == NULL)
+    return NULL;
+  key.tid = tid;
+  e = hash_find (cur->children, &key.elem);
+  return e != NULL ? hash_entry (e, struct child, elem) : NULL;
+}
+
+/* What start_process() needs from process_execute(), which waits
+   on wait_load until the child has read it. */
+struct exec_args
+  {
+    char *cmd_line;             /* Command line, in a page. */
+    struct child *child;        /* The child's record. */
+  };
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
    before process_execute() returns.  Returns the new process's
@@ -31,10 +140,9 @@ process_execute (const char *file_name)
 {
   char *fn_copy;
   tid_t tid;
-  struct thread* cur;
-  struct list_elem* celem;
-  struct list_elem* end;
-  	int i,ret;
+  struct exec_args args;
+  struct child *c;
+  	int i;
  	char command[256];
  /* Make a copy of FILE_NAME.
      Otherwise there's a race between the caller and load(). */
@@ -49,39 +157,54 @@ process_execute (const char *file_name)
   	if(filesys_open(command)==NULL){
 		return -1;
 	}
+  c = child_new ();
+  if (c == NULL)
+    {
+      palloc_free_page (fn_copy);
+      return TID_ERROR;
+    }
+  args.cmd_line = fn_copy;
+  args.child = c;
   /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (command, PRI_DEFAULT, start_process, fn_copy);
+  tid = thread_create (command, PRI_DEFAULT, start_process, &args);
   if (tid == TID_ERROR)
-    palloc_free_page (fn_copy); 
+    {
+      palloc_free_page (fn_copy); 
+      free (c);
+      return TID_ERROR;
+    }
+  if (!child_add (c, tid))
+    child_release (c);
   sema_down(&(thread_current()->wait_load));
-  celem = list_begin(&(thread_current()->childs));
-  end = list_end(&(thread_current()->childs));
-  while(celem != end){
-	cur = list_entry(celem,struct thread, element);
- 	if(cur->is_load == -1){
-		ret = process_wait(tid);
-		return ret;
-	}
-	celem = list_next(celem);
-  }
+  if (child_lookup (tid) == c && c->load_status == -1)
+    return process_wait (tid);
   return tid;
 }
 
 /* A thread function that loads a user process and starts it
    running. */
 static void
-start_process (void *file_name_)
+start_process (void *args_)
 {
-  char *file_name = file_name_;
+  struct exec_args *args = args_;
+  char *file_name = args->cmd_line;
   struct intr_frame if_;
   bool success;
 
+  thread_current ()->as_child = args->child;
+
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
+#ifdef VM
+  sup_page_init ();
+#endif
   success = load (file_name, &if_.eip, &if_.esp);
+  // Argument passing: step1. Construct Stack
+  if (success)
+	makeup_stack(&if_.esp,file_name);
   /* If load failed, quit. */
   palloc_free_page (file_name);
   struct thread *t = thread_current();
@@ -93,13 +216,10 @@ start_process (void *file_name_)
   else {
     t->cwd = dir_open_root();
   }
+  t->as_child->load_status = success ? 1 : -1;
   sema_up(&(thread_current()->p->wait_load));
-  if(!success){
-    thread_current()->is_load = -1;
+  if(!success)
     exit(-1); //to close fd in exit()
-  }
-  else 
-    thread_current()->is_load = 1;
 
   /* Start the user process by simulating a return from an
      interrupt, implemented by intr_exit (in
@@ -111,35 +231,287 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+/* Gives the current thread its own handle on files and
+   directories PARENT has open, under the same fd numbers and at
+   the same positions: the FD_CNT fds listed in FDS, or all of
+   them if FDS is null.  Console fds and fds PARENT does not have
+   open are skipped. */
+static bool
+inherit_fds (struct thread *parent, const int *fds, int fd_cnt)
+{
+  struct thread *t = thread_current ();
+  int i, cnt = fds != NULL ? fd_cnt : parent->fd_cap;
+
+  if (parent->fd_cap == 0 || cnt == 0)
+    return true;
+  t->fds = calloc (parent->fd_cap, sizeof *t->fds);
+  t->fd_used = bitmap_create (parent->fd_cap);
+  if (t->fds == NULL || t->fd_used == NULL)
+    return false;
+  t->fd_cap = parent->fd_cap;
+  bitmap_set_multiple (t->fd_used, 0, 3, true);
+  for (i = 0; i < cnt; i++)
+    {
+      int fd = fds != NULL ? fds[i] : i;
+      struct Fd *from, *to;
+      if (fd < 3 || fd >= parent->fd_cap || t->fds[fd] != NULL
+          || (from = parent->fds[fd]) == NULL)
+        continue;
+      to = malloc (sizeof *to);
+      if (to == NULL)
+        return false;
+      to->file = file_reopen (from->file);
+      to->dir = from->dir != NULL ? dir_reopen (from->dir) : NULL;
+      to->num = from->num;
+      t->fds[fd] = to;
+      bitmap_mark (t->fd_used, fd);
+      if (to->file == NULL)
+        return false;
+      file_seek (to->file, file_tell (from->file));
+    }
+  return true;
+}
+
+/* What start_spawn() needs from process_spawn(), which waits on
+   wait_load until the child is done with it. */
+struct spawn_args
+  {
+    const char *file;           /* Executable to load, in kernel memory. */
+    const uint8_t *stack;       /* Initial stack, to end at PHYS_BASE. */
+    size_t stack_size;          /* Bytes in STACK. */
+    const int *fds;             /* Fds to inherit. */
+    int fd_cnt;                 /* Number of FDS. */
+    struct child *child;        /* The child's record. */
+  };
+
+static thread_func start_spawn NO_RETURN;
+
+/* Starts a process running FILE, whose initial user stack is the
+   STACK_SIZE bytes at STACK, laid out with pointers for its final
+   place just below PHYS_BASE.  The child also gets the FD_CNT open
+   files listed in FDS under the same numbers.  Unlike
+   process_execute(), a child that fails to load is not waited
+   for.  FILE, STACK and FDS must be in kernel memory, since the
+   child reads them from its own address space.  Returns the
+   child's tid, or TID_ERROR if it could not be started. */
+tid_t
+process_spawn (const char *file, const void *stack, size_t stack_size,
+               const int *fds, int fd_cnt)
+{
+  struct thread *cur = thread_current ();
+  struct spawn_args args;
+  struct child *c;
+  bool added;
+  tid_t tid;
+
+  c = child_new ();
+  if (c == NULL)
+    return TID_ERROR;
+  args.file = file;
+  args.stack = stack;
+  args.stack_size = stack_size;
+  args.fds = fds;
+  args.fd_cnt = fd_cnt;
+  args.child = c;
+  tid = thread_create (file, PRI_DEFAULT, start_spawn, &args);
+  if (tid == TID_ERROR)
+    {
+      free (c);
+      return TID_ERROR;
+    }
+  added = child_add (c, tid);
+  sema_down (&cur->wait_load);
+  if (c->load_status == -1)
+    {
+      /* The child reports its exit to the record and frees it. */
+      if (added)
+        hash_delete (cur->children, &c->elem);
+      tid = TID_ERROR;
+    }
+  if (!added || tid == TID_ERROR)
+    child_release (c);
+  return tid;
+}
+
+/* A thread function that loads the program process_spawn() asked
+   for, copies in the prepared stack and starts it running. */
+static void
+start_spawn (void *args_)
+{
+  struct spawn_args *args = args_;
+  struct thread *t = thread_current ();
+  struct intr_frame if_;
+  bool success;
+
+  t->as_child = args->child;
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+#ifdef VM
+  sup_page_init ();
+#endif
+  success = (load (args->file, &if_.eip, &if_.esp)
+             && inherit_fds (t->p, args->fds, args->fd_cnt));
+  if (success)
+    {
+      if_.esp = (uint8_t *) if_.esp - args->stack_size;
+      memcpy (if_.esp, args->stack, args->stack_size);
+    }
+  t->cwd = t->p->cwd != NULL ? dir_reopen (t->p->cwd) : dir_open_root ();
+  t->as_child->load_status = success ? 1 : -1;
+  sema_up (&t->p->wait_load);
+  if (!success)
+    exit (-1);
+
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+#ifdef VM
+/* What a forked child needs from its parent. */
+struct fork_args
+  {
+    struct intr_frame if_;      /* Parent's user registers. */
+    struct thread *parent;      /* Waits until the copy is done. */
+    struct child *child;        /* The child's record. */
+  };
+
+static thread_func fork_process NO_RETURN;
+
+/* Creates a child process that is a copy of the current one.  The
+   child resumes where the parent made the system call, seeing 0
+   as the result.  Returns the child's tid, or TID_ERROR. */
+tid_t
+process_fork (void)
+{
+  struct thread *cur = thread_current ();
+  struct fork_args *args;
+  struct child *c;
+  tid_t tid;
+
+  args = malloc (sizeof *args);
+  c = child_new ();
+  if (args == NULL || c == NULL)
+    {
+      free (args);
+      free (c);
+      return TID_ERROR;
+    }
+  /* A system call from user mode leaves its frame at the top of
+     the thread's kernel stack. */
+  args->if_ = ((struct intr_frame *) ((uint8_t *) cur + PGSIZE))[-1];
+  args->parent = cur;
+  args->child = c;
+  tid = thread_create (cur->name, PRI_DEFAULT, fork_process, args);
+  if (tid == TID_ERROR)
+    {
+      free (args);
+      free (c);
+      return TID_ERROR;
+    }
+  if (!child_add (c, tid))
+    child_release (c);
+  sema_down (&cur->wait_load);
+  if (child_lookup (tid) == c && c->load_status == -1)
+    {
+      process_wait (tid);
+      return TID_ERROR;
+    }
+  return tid;
+}
+
+/* Copies PARENT's user memory into a new page directory for the
+   current thread.  Pages in the supplemental page table are shared
+   copy-on-write; stack pages, which are not, are copied. */
+static bool
+fork_memory (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage;
+
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL)
+    return false;
+  process_activate ();
+  sup_page_init ();
+  if (parent->exec_file != NULL)
+    {
+      t->exec_file = file_reopen (parent->exec_file);
+      if (t->exec_file == NULL)
+        return false;
+      file_deny_write (t->exec_file);
+    }
+  if (!sup_page_fork (parent, t->exec_file))
+    return false;
+
+  t->current_stack = parent->current_stack;
+  for (upage = (uint8_t *) PHYS_BASE - parent->current_stack;
+       upage < (uint8_t *) PHYS_BASE; upage += PGSIZE)
+    {
+      void *kpage = pagedir_get_page (parent->pagedir, upage);
+      void *copy;
+      if (kpage == NULL || pagedir_get_page (t->pagedir, upage) != NULL)
+        continue;
+      copy = palloc_get_page (PAL_USER);
+      if (copy == NULL)
+        return false;
+      memcpy (copy, kpage, PGSIZE);
+      if (!pagedir_set_page (t->pagedir, upage, copy, true))
+        {
+          palloc_free_page (copy);
+          return false;
+        }
+    }
+  return true;
+}
+
+/* A thread function that turns a new thread into a copy of the
+   process that called fork() and returns to user mode. */
+static void
+fork_process (void *args_)
+{
+  struct fork_args *args = args_;
+  struct thread *t = thread_current ();
+  struct thread *parent = args->parent;
+  struct intr_frame if_ = args->if_;
+  bool success;
+
+  t->as_child = args->child;
+  free (args);
+  success = fork_memory (parent) && inherit_fds (parent, NULL, 0);
+  t->cwd = parent->cwd != NULL ? dir_reopen (parent->cwd) : dir_open_root ();
+  t->ring = parent->ring;
+  t->as_child->load_status = success ? 1 : -1;
+  sema_up (&parent->wait_load);
+  if (!success)
+    exit (-1);
+
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+#endif
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
    child of the calling process, or if process_wait() has already
    been successfully called for the given TID, returns -1
-   immediately, without waiting.
-
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+   immediately, without waiting. */
 int
-process_wait (tid_t child_tid UNUSED) 
+process_wait (tid_t child_tid) 
 {
-	struct thread* thd = NULL;
-	struct list_elem* cur = list_begin(&(thread_current()->childs));
-	struct list_elem* end = list_end(&(thread_current()->childs));
-	if(child_tid == TID_ERROR || cur == end) 
-		return -1;
-	do{
-		thd = list_entry(cur,struct thread, element);
-		if(thd->tid == child_tid){
-			sema_down(&(thd->pblock)); //wait child thread
-			list_remove(&(thd->element));
-			sema_up(&(thd->defer_block)); //after remove memory child can die
-			return thd->exit_number;
-		}
-		cur = list_next(cur);
-	}while(cur != end);
-	
-  return -1;
+  struct child *c = child_lookup (child_tid);
+  int status;
+
+  if (c == NULL)
+    return -1;
+  sema_down (&c->exited);
+  status = c->exit_status;
+  hash_delete (thread_current ()->children, &c->elem);
+  child_release (c);
+  return status;
 }
 
 /* Free the current process's resources. */
@@ -147,19 +519,37 @@ void
 process_exit (void)
 {
   struct thread *cur = thread_current ();
-  struct list *fds = &cur->fd_head;
-  struct list_elem *ecur;
   struct Fd *fcur;
   uint32_t *pd;
+  int fd;
 
-  for(;!list_empty(fds);) {
-    ecur = list_pop_front(fds);
-    fcur = list_entry(ecur, struct Fd, elem);
+  for(fd = 0; fd < cur->fd_cap; fd++) {
+    fcur = cur->fds[fd];
+    if(fcur == NULL)
+      continue;
     file_close(fcur->file);
-    palloc_free_page(fcur); 
+    if(fcur->dir)
+      dir_close(fcur->dir);
+    free(fcur);
   }
+  free(cur->fds);
+  if(cur->fd_used) bitmap_destroy(cur->fd_used);
+  cur->fds = NULL;
+  cur->fd_used = NULL;
+  cur->fd_cap = 0;
   if(cur->cwd) dir_close (cur->cwd);
 
+#ifdef VM
+  /* Unmapping writes dirty pages back, so it must happen while
+     the page directory still records which pages were written. */
+  while (!list_empty (&cur->mmaps))
+    munmap (list_entry (list_front (&cur->mmaps), struct mapping, elem)->id);
+  if (cur->pagedir != NULL)
+    sup_page_destroy ();
+  file_close (cur->exec_file);
+  cur->exec_file = NULL;
+#endif
+
   pd = cur->pagedir;
   if (pd != NULL) 
     {
@@ -174,8 +564,23 @@ process_exit (void)
       pagedir_activate (NULL);
       pagedir_destroy (pd);
     }
-  	sema_up(&(cur->pblock)); //end child thread
-	sema_down(&(cur->defer_block)); //but deferring for memory remove
+
+  /* Children no longer have anyone to report to, and the parent
+     learns of this exit from the record, not from this thread,
+     which may now be freed. */
+  if (cur->children != NULL)
+    {
+      hash_destroy (cur->children, child_destroy);
+      free (cur->children);
+      cur->children = NULL;
+    }
+  if (cur->as_child != NULL)
+    {
+      cur->as_child->exit_status = cur->exit_number;
+      sema_up (&cur->as_child->exited);
+      child_release (cur->as_child);
+      cur->as_child = NULL;
+    }
 }
 
 /* Sets up the CPU for running user code in the current
@@ -263,37 +668,124 @@ static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
-   Stores the executable's entry point into *EIP
-   and its initial stack pointer into *ESP.
-   Returns true if successful, false otherwise. */
-bool
-load (const char *file_name, void (**eip) (void), void **esp) 
+/* Most loadable segments a load plan holds.  Pintos executables
+   have two or three. */
+#define PLAN_SEGS 16
+
+/* Load plans kept for recently run executables. */
+#define PLAN_CACHE_SIZE 8
+
+/* A PT_LOAD segment, validated and reduced to the arguments of
+   load_segment(). */
+struct plan_seg
+  {
+    uint32_t file_page;
+    uint32_t mem_page;
+    uint32_t read_bytes;
+    uint32_t zero_bytes;
+    bool writable;
+  };
+
+/* What load() learns from an executable's ELF header and program
+   headers. */
+struct load_plan
+  {
+    uint32_t entry;                     /* Entry point. */
+    int seg_cnt;                        /* Number of SEGS in use. */
+    bool complete;                      /* False if SEGS overflowed. */
+    struct plan_seg segs[PLAN_SEGS];
+  };
+
+/* A cached load plan.  It holds no reference to its inode, which
+   may be removed and freed meanwhile: generations are never
+   reused, and an inode opened again gets a new one, so a stale
+   entry just never matches again and ages out. */
+struct plan_entry
+  {
+    block_sector_t sector;              /* Inode's sector. */
+    unsigned gen;                       /* Its generation when read,
+                                           0 if the slot is free. */
+    unsigned last_use;                  /* For LRU replacement. */
+    struct load_plan plan;
+  };
+
+static struct plan_entry plan_cache[PLAN_CACHE_SIZE];
+static unsigned plan_clock;
+static struct lock plan_lock;
+
+/* Initializes the load plan cache. */
+void
+process_init (void)
 {
-  struct thread *t = thread_current ();
-  struct Elf32_Ehdr ehdr;
-  struct file *file = NULL;
-  off_t file_ofs;
-  bool success = false;
+  lock_init (&plan_lock);
+}
+
+/* Copies the cached plan for generation GEN of INODE into *PLAN.
+   Returns false if there is none. */
+static bool
+plan_lookup (struct inode *inode, unsigned gen, struct load_plan *plan)
+{
+  block_sector_t sector = inode_get_inumber (inode);
+  bool hit = false;
   int i;
-	char command[50];
 
-  /* Allocate and activate page directory. */
-  t->pagedir = pagedir_create ();
-  if (t->pagedir == NULL) 
-    goto done;
-  process_activate ();
-	//before filesys_open, parsing
-	strlcpy(command,file_name,strlen(file_name)+1);
-	for(i=0;command[i]!=' '&&command[i]!='\0';i++);
-	command[i] = '\0';
-  /* Open executable file. */
-  file = filesys_open (command);
-  if (file == NULL) 
+  lock_acquire (&plan_lock);
+  for (i = 0; i < PLAN_CACHE_SIZE; i++)
     {
-      printf ("load: %s: open failed\n", command);
-      goto done; 
+      struct plan_entry *e = &plan_cache[i];
+      if (e->gen != 0 && e->sector == sector && e->gen == gen)
+        {
+          *plan = e->plan;
+          e->last_use = ++plan_clock;
+          hit = true;
+          break;
+        }
+    }
+  lock_release (&plan_lock);
+  return hit;
+}
+
+/* Caches PLAN, read from generation GEN of INODE.  It replaces an
+   older plan for the same inode, else the least recently used. */
+static void
+plan_store (struct inode *inode, unsigned gen, const struct load_plan *plan)
+{
+  block_sector_t sector = inode_get_inumber (inode);
+  struct plan_entry *victim = NULL;
+  int i;
+
+  lock_acquire (&plan_lock);
+  for (i = 0; i < PLAN_CACHE_SIZE; i++)
+    {
+      struct plan_entry *e = &plan_cache[i];
+      if (e->gen == 0 || e->sector == sector)
+        {
+          victim = e;
+          break;
+        }
+      if (victim == NULL || e->last_use < victim->last_use)
+        victim = e;
     }
+  victim->sector = sector;
+  victim->gen = gen;
+  victim->last_use = ++plan_clock;
+  victim->plan = *plan;
+  lock_release (&plan_lock);
+}
+
+/* Reads and validates the ELF header and program headers of FILE,
+   the executable FILE_NAME, into *PLAN.  Segments that don't fit
+   in PLAN->segs leave PLAN->complete false.  If LOAD_SEGS, each
+   segment is instead loaded as it is found, as for an executable
+   with too many segments to plan.  Returns true if successful,
+   false if FILE cannot be loaded. */
+static bool
+read_plan (struct file *file, const char *file_name, struct load_plan *plan,
+           bool load_segs)
+{
+  struct Elf32_Ehdr ehdr;
+  off_t file_ofs;
+  int i;
 
   /* Read and verify executable header. */
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
@@ -305,8 +797,11 @@ load (const char *file_name, void (**eip) (void), void **esp)
       || ehdr.e_phnum > 1024) 
     {
       printf ("load: %s: error loading executable\n", file_name);
-      goto done; 
+      return false;
     }
+  plan->entry = ehdr.e_entry;
+  plan->seg_cnt = 0;
+  plan->complete = true;
 
   /* Read program headers. */
   file_ofs = ehdr.e_phoff;
@@ -315,11 +810,11 @@ load (const char *file_name, void (**eip) (void), void **esp)
       struct Elf32_Phdr phdr;
 
       if (file_ofs < 0 || file_ofs > file_length (file))
-        goto done;
+        return false;
       file_seek (file, file_ofs);
 
       if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-        goto done;
+        return false;
       file_ofs += sizeof phdr;
       switch (phdr.p_type) 
         {
@@ -333,51 +828,129 @@ load (const char *file_name, void (**eip) (void), void **esp)
         case PT_DYNAMIC:
         case PT_INTERP:
         case PT_SHLIB:
-          goto done;
+          return false;
         case PT_LOAD:
           if (validate_segment (&phdr, file)) 
             {
-              bool writable = (phdr.p_flags & PF_W) != 0;
-              uint32_t file_page = phdr.p_offset & ~PGMASK;
-              uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
+              struct plan_seg seg;
               uint32_t page_offset = phdr.p_vaddr & PGMASK;
-              uint32_t read_bytes, zero_bytes;
+              seg.writable = (phdr.p_flags & PF_W) != 0;
+              seg.file_page = phdr.p_offset & ~PGMASK;
+              seg.mem_page = phdr.p_vaddr & ~PGMASK;
               if (phdr.p_filesz > 0)
                 {
                   /* Normal segment.
                      Read initial part from disk and zero the rest. */
-                  read_bytes = page_offset + phdr.p_filesz;
-                  zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-                                - read_bytes);
+                  seg.read_bytes = page_offset + phdr.p_filesz;
+                  seg.zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz,
+                                              PGSIZE)
+                                    - seg.read_bytes);
                 }
               else 
                 {
                   /* Entirely zero.
                      Don't read anything from disk. */
-                  read_bytes = 0;
-                  zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
+                  seg.read_bytes = 0;
+                  seg.zero_bytes = ROUND_UP (page_offset + phdr.p_memsz,
+                                             PGSIZE);
                 }
-              if (!load_segment (file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable))
-                goto done;
+              if (load_segs)
+                {
+                  if (!load_segment (file, seg.file_page,
+                                     (void *) seg.mem_page, seg.read_bytes,
+                                     seg.zero_bytes, seg.writable))
+                    return false;
+                }
+              else if (plan->seg_cnt < PLAN_SEGS)
+                plan->segs[plan->seg_cnt++] = seg;
+              else
+                plan->complete = false;
             }
           else
-            goto done;
+            return false;
           break;
         }
     }
+  return true;
+}
+
+/* Loads an ELF executable from FILE_NAME into the current thread.
+   Stores the executable's entry point into *EIP
+   and its initial stack pointer into *ESP.
+   Returns true if successful, false otherwise. */
+bool
+load (const char *file_name, void (**eip) (void), void **esp) 
+{
+  struct thread *t = thread_current ();
+  struct load_plan plan;
+  struct file *file = NULL;
+  struct inode *inode;
+  unsigned gen;
+  bool success = false;
+  int i;
+	char command[50];
+
+  /* Allocate and activate page directory. */
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL) 
+    goto done;
+  process_activate ();
+	//before filesys_open, parsing
+	strlcpy(command,file_name,strlen(file_name)+1);
+	for(i=0;command[i]!=' '&&command[i]!='\0';i++);
+	command[i] = '\0';
+  /* Open executable file. */
+  file = filesys_open (command);
+  if (file == NULL) 
+    {
+      printf ("load: %s: open failed\n", command);
+      goto done; 
+    }
+
+  /* Read and verify the ELF headers, unless a plan made from the
+     same contents of the file is cached.  An executable with more
+     segments than a plan holds is loaded straight from its
+     headers, uncached. */
+  inode = file_get_inode (file);
+  gen = inode_generation (inode);
+  if (!plan_lookup (inode, gen, &plan))
+    {
+      if (!read_plan (file, file_name, &plan, false))
+        goto done;
+      if (plan.complete)
+        plan_store (inode, gen, &plan);
+      else if (!read_plan (file, file_name, &plan, true))
+        goto done;
+    }
+  for (i = 0; i < plan.seg_cnt; i++)
+    {
+      const struct plan_seg *seg = &plan.segs[i];
+      if (!load_segment (file, seg->file_page, (void *) seg->mem_page,
+                         seg->read_bytes, seg->zero_bytes, seg->writable))
+        goto done;
+    }
 
   /* Set up stack. */
   if (!setup_stack (esp))
     goto done;
-  // Argument passing: step1. Construct Stack
-	makeup_stack(esp,file_name);
   /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
+  *eip = (void (*) (void)) plan.entry;
   success = true;
  done:
   /* We arrive here whether the load is successful or not. */
+#ifdef VM
+  /* Segment pages are read from FILE as they are touched, so a
+     loaded process keeps it open, and unwritable, until exit. */
+  if (success)
+    {
+      file_deny_write (file);
+      t->exec_file = file;
+    }
+  else
+    file_close (file);
+#else
   file_close (file);
+#endif
   return success;
 }
 
@@ -443,7 +1016,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    user process if WRITABLE is true, read-only otherwise.
 
    Return true if successful, false if a memory allocation error
-   or disk read error occurs. */
+   or disk read error occurs.
+
+   With VM, pages are only recorded in the supplemental page table
+   here and the page fault handler reads each one on first touch. */
 static bool
 load_segment (struct file *file, off_t ofs, uint8_t *upage,
               uint32_t read_bytes, uint32_t zero_bytes, bool writable) 
@@ -452,6 +1028,21 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  while (read_bytes > 0 || zero_bytes > 0) 
+    {
+      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+      size_t page_zero_bytes = PGSIZE - page_read_bytes;
+
+      if (!page_add_file (upage, file, ofs, page_read_bytes, writable, false))
+        return false;
+
+      read_bytes -= page_read_bytes;
+      zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
+      upage += PGSIZE;
+    }
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
@@ -486,6 +1077,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       zero_bytes -= page_zero_bytes;
       upage += PGSIZE;
     }
+#endif
   return true;
 }
 
@@ -3,10 +3,16 @@
 
 #include "threads/thread.h"
 
+void process_init (void);
 tid_t process_execute (const char *file_name);
+tid_t process_spawn (const char *file, const void *stack, size_t stack_size,
+                     const int *fds, int fd_cnt);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
+#ifdef VM
+tid_t process_fork (void);
+#endif
 
 
 #endif /* userprog/process.h */
@@ -1,5 +1,7 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
+#include <round.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -15,30 +17,160 @@
 #include "threads/malloc.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
+#include "filesys/snapshot.h"
 #include <stdbool.h>
 #include "threads/synch.h"
+#include <bitmap.h>
+#ifdef VM
+#include "vm/page.h"
+#endif
+
+/* Slots in a process's first fd table; it doubles when full. */
+#define FD_INIT 16
 
 enum file_or_dir { F=1, D=2 };
 static struct Fd* get_file(int dnum, enum file_or_dir flag)
 {
   struct thread* tcur = thread_current();
-  struct list_elem *ecur;
-  if(tcur != NULL && dnum >=3){
-  if (! list_empty(&tcur->fd_head)) {
-    for(ecur = list_begin(&tcur->fd_head);
-        ecur != list_end(&tcur->fd_head); ecur = list_next(ecur))
-    {
-      struct Fd *fcur = list_entry(ecur, struct Fd, elem);
-      if(fcur->num == dnum) {
-        if (fcur->dir != NULL && (flag & D) )
-          return fcur;
-        else if (fcur->dir == NULL && (flag & F) )
-          return fcur;
-      }
-    }
+  struct Fd *fcur;
+  if(dnum < 3 || dnum >= tcur->fd_cap)
+    return NULL;
+  fcur = tcur->fds[dnum];
+  if(fcur == NULL)
+    return NULL;
+  if (fcur->dir != NULL && (flag & D) )
+    return fcur;
+  else if (fcur->dir == NULL && (flag & F) )
+    return fcur;
+  return NULL; 
+}
+
+/* Doubles the fd table of T.  Fd numbers 0 to 2 are reserved for
+   the console.  Returns false if out of memory. */
+static bool grow_fds(struct thread* t)
+{
+  int cap = t->fd_cap ? t->fd_cap * 2 : FD_INIT;
+  struct Fd** fds;
+  struct bitmap* used;
+  int i;
+  used = bitmap_create(cap);
+  if(used == NULL)
+    return false;
+  fds = realloc(t->fds, cap * sizeof *fds);
+  if(fds == NULL) {
+    bitmap_destroy(used);
+    return false;
   }
+  memset(fds + t->fd_cap, 0, (cap - t->fd_cap) * sizeof *fds);
+  bitmap_set_multiple(used, 0, 3, true);
+  for(i = 3; i < t->fd_cap; i++)
+    bitmap_set(used, i, bitmap_test(t->fd_used, i));
+  if(t->fd_used != NULL)
+    bitmap_destroy(t->fd_used);
+  t->fds = fds;
+  t->fd_used = used;
+  t->fd_cap = cap;
+  return true;
+}
+
+/* Gives FCUR the lowest free fd number of the current process.
+   Returns it, or -1 if out of memory. */
+static int alloc_fd(struct Fd* fcur)
+{
+  struct thread* t = thread_current();
+  size_t fd = BITMAP_ERROR;
+  if(t->fd_used != NULL)
+    fd = bitmap_scan_and_flip(t->fd_used, 0, 1, false);
+  if(fd == BITMAP_ERROR) {
+    if(!grow_fds(t))
+      return -1;
+    fd = bitmap_scan_and_flip(t->fd_used, 0, 1, false);
   }
-  return NULL; 
+  t->fds[fd] = fcur;
+  fcur->num = fd;
+  return fd;
+}
+
+/* Reads a byte at user virtual address UADDR, which must be
+   below PHYS_BASE.  Returns the byte value if successful, -1 if
+   a segfault occurred; see page_fault(), which only recovers
+   faults taken while the thread is marked as probing. */
+static int
+get_user (const uint8_t *uaddr)
+{
+  struct thread *t = thread_current ();
+  int result;
+  t->probing = true;
+  barrier ();
+  asm ("movl $1f, %0; movzbl %1, %0; 1:"
+       : "=&a" (result) : "m" (*uaddr));
+  barrier ();
+  t->probing = false;
+  return result;
+}
+
+/* Writes BYTE to user address UDST, which must be below
+   PHYS_BASE.  Returns true if successful, false if a segfault
+   occurred. */
+static bool
+put_user (uint8_t *udst, uint8_t byte)
+{
+  struct thread *t = thread_current ();
+  int error_code;
+  t->probing = true;
+  barrier ();
+  asm ("movl $1f, %0; movb %b2, %1; 1:"
+       : "=&a" (error_code), "=m" (*udst) : "q" (byte));
+  barrier ();
+  t->probing = false;
+  return error_code != -1;
+}
+
+/* Returns word N of the system call frame at F->esp, word 0 being
+   the call number.  Kills the process if it can't be read. */
+static uint32_t get_arg(struct intr_frame *f, int n)
+{
+  const uint8_t *uaddr = (const uint8_t *)f->esp + 4 * n;
+  uint32_t word = 0;
+  int i, byte;
+  for(i = 3; i >= 0; i--) {
+    if(!is_user_vaddr(uaddr + i) || (byte = get_user(uaddr + i)) == -1)
+      exit(-1);
+    word = (word << 8) | byte;
+  }
+  return word;
+}
+
+/* Kills the process unless the SIZE bytes at user address BUFFER
+   can be read, and written too if WRITE.  Touches one byte per
+   page, so large buffers cost next to nothing, and faults in
+   stack pages on the way.  Call it before taking any lock. */
+static void check_user_buffer(const void* buffer, size_t size, bool write)
+{
+  const uint8_t *p = buffer, *end = p + size;
+  int byte;
+  if(size == 0)
+    return;
+  if(end < p || !is_user_vaddr(end - 1))
+    exit(-1);
+  for(; p < end; p = (const uint8_t *)pg_round_down(p) + PGSIZE) {
+    byte = get_user(p);
+    if(byte == -1 || (write && !put_user((uint8_t *)p, byte)))
+      exit(-1);
+  }
+}
+
+/* Kills the process unless STR is a readable, null-terminated
+   string in user memory. */
+static void check_user_string(const char* str)
+{
+  const uint8_t *p = (const uint8_t *)str;
+  int byte;
+  do {
+    if(!is_user_vaddr(p) || (byte = get_user(p)) == -1)
+      exit(-1);
+    p++;
+  } while(byte != 0);
 }
 
 static void syscall_handler (struct intr_frame *);
@@ -52,135 +184,180 @@ syscall_init (void)
   readcnt = 0;
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
-static void
-syscall_handler (struct intr_frame *f UNUSED) 
-{
-	int i,p[4];
-	switch(*(uint32_t*)(f->esp)){
-		case SYS_HALT:
-			halt();
-			break;
-		case SYS_EXIT:
-			p[0] = *(uint32_t *)(f->esp+4);
-			protect_user_memory((const void*)p[0]);
-			exit(p[0]);
-			break;
-		case SYS_EXEC:
-			p[0] = *(uint32_t *)(f->esp+4);
-			protect_user_memory((const void*)p[0]);
-			f->eax = exec(p[0]);
-			break;
-		case SYS_WAIT:
-			p[0] = *(uint32_t *)(f->esp+4);
-			protect_user_memory((const void*)p[0]);
-			f->eax = wait((pid_t)p[0]);
-			break;
-		case SYS_CREATE:
-			for(i=0;i<2;i++){
-				p[i] = *(uint32_t *)(f->esp+(4*(i+1)));
-				protect_user_memory((const void*)p[i]);
-			}
-			if(p[0] == NULL)
-				exit(-1);
-			f->eax = create((const char*)p[0],(unsigned)p[1]);
-			break;
-		case SYS_REMOVE:
-			p[0] = *(uint32_t *)(f->esp+4);
-			protect_user_memory((const void*)p[0]);
-			if(p[0] == NULL)
-				exit(-1);
-			f->eax = remove((const char*)p[0]);
-			break;
-		case SYS_OPEN:
-			p[0] = *(uint32_t *)(f->esp+4);
-			protect_user_memory((const void*)p[0]);
-			if(p[0] == NULL)
-				exit(-1);
-			f->eax = open((const char*)p[0]);
-			break;
-		case SYS_FILESIZE:
-			p[0] = *(uint32_t *)(f->esp+4);
-			protect_user_memory((const void*)p[0]);
-			f->eax = filesize((int)p[0]);
-			break;
-		case SYS_READ:
-			for(i=0;i<3;i++){
-				p[i] = *(uint32_t *)(f->esp+(4*(i+1)));
-				protect_user_memory((const void*)p[i]);
-			}
-			f->eax = read((int)p[0],(void*)p[1],(unsigned)p[2]);
-			break;
-		case SYS_WRITE:
-			for(i=0;i<3;i++){
-				p[i] = *(uint32_t *)(f->esp+(4*(i+1)));
-				protect_user_memory((const void*)p[i]);
-			}
-			f->eax = write((int)p[0],(void*)p[1],(unsigned)p[2]);
-			break;
-		case SYS_SEEK:
-			for(i=0;i<2;i++){
-				p[i] = *(uint32_t *)(f->esp+(4*(i+1)));
-				protect_user_memory((const void*)p[i]);
-			}
-			seek((int)p[0],(unsigned)p[1]);
-			break;
-		case SYS_TELL:
-			p[0] = *(uint32_t *)(f->esp+4);
-			protect_user_memory((const void*)p[0]);
-			f->eax = tell((int)p[0]);
-			break;
-		case SYS_CLOSE:
-			p[0] = *(uint32_t *)(f->esp+4);
-			protect_user_memory((const void*)p[0]);
-			close((int)p[0]);
-			break;
-		case SYS_FIBO:
-			p[0] = *(uint32_t *)(f->esp+4);
-			protect_user_memory((const void*)p[0]);
-			f->eax = fibonacci((int)p[0]);
-			break;
-		case SYS_MAXFOUR:
-			for(i=0;i<4;i++){
-				p[i] = *(uint32_t *)(f->esp+(4*(i+1)));
-				protect_user_memory((const void*)p[i]);
-			}
-			f->eax = max_of_four_int((int)p[0],(int)p[1],(int)p[2],(int)p[3]);
-			break;
+/* Calls the system call with ARGS, its arguments. */
+typedef uint32_t syscall_func (const uint32_t *args);
+
+static uint32_t sys_halt (const uint32_t *a UNUSED) { halt (); NOT_REACHED (); }
+static uint32_t sys_exit (const uint32_t *a) { exit (a[0]); NOT_REACHED (); }
+static uint32_t sys_exec (const uint32_t *a) { return exec ((const char *) a[0]); }
+static uint32_t sys_wait (const uint32_t *a) { return wait (a[0]); }
+static uint32_t sys_create (const uint32_t *a) { return create ((const char *) a[0], a[1]); }
+static uint32_t sys_remove (const uint32_t *a) { return remove ((const char *) a[0]); }
+static uint32_t sys_open (const uint32_t *a) { return open ((const char *) a[0]); }
+static uint32_t sys_filesize (const uint32_t *a) { return filesize (a[0]); }
+static uint32_t sys_read (const uint32_t *a) { return read (a[0], (void *) a[1], a[2]); }
+static uint32_t sys_write (const uint32_t *a) { return write (a[0], (const void *) a[1], a[2]); }
+static uint32_t sys_seek (const uint32_t *a) { seek (a[0], a[1]); return 0; }
+static uint32_t sys_tell (const uint32_t *a) { return tell (a[0]); }
+static uint32_t sys_close (const uint32_t *a) { close (a[0]); return 0; }
+static uint32_t sys_fibo (const uint32_t *a) { return fibonacci (a[0]); }
+static uint32_t sys_maxfour (const uint32_t *a) { return max_of_four_int (a[0], a[1], a[2], a[3]); }
+static uint32_t sys_pread (const uint32_t *a) { return pread (a[0], (void *) a[1], a[2], a[3]); }
+static uint32_t sys_pwrite (const uint32_t *a) { return pwrite (a[0], (const void *) a[1], a[2], a[3]); }
+static uint32_t sys_readv (const uint32_t *a) { return readv (a[0], (const struct iovec *) a[1], a[2]); }
+static uint32_t sys_writev (const uint32_t *a) { return writev (a[0], (const struct iovec *) a[1], a[2]); }
+static uint32_t sys_copy_file_range (const uint32_t *a) { return copy_file_range (a[0], a[1], a[2]); }
+static uint32_t sys_ring_setup (const uint32_t *a) { return ring_setup ((struct sys_ring *) a[0]); }
+static uint32_t sys_ring_enter (const uint32_t *a UNUSED) { return ring_enter (); }
+static uint32_t sys_spawn (const uint32_t *a) { return spawn ((const char *) a[0], (char *const *) a[1], (const int *) a[2], a[3]); }
+#ifdef VM
+static uint32_t sys_fork (const uint32_t *a UNUSED) { return fork (); }
+static uint32_t sys_mmap (const uint32_t *a) { return mmap (a[0], (void *) a[1]); }
+static uint32_t sys_munmap (const uint32_t *a) { munmap (a[0]); return 0; }
+#endif
 #ifdef FILESYS
- 		case SYS_CHDIR: 
-			p[0] = *(uint32_t *)(f->esp+4);
-			protect_user_memory((const void*)p[0]);
-	     	 	f->eax = chdir((const char*)p[0]);
-		     	break;
-  		case SYS_MKDIR: 
-			p[0] = *(uint32_t *)(f->esp+4);
-			protect_user_memory((const void*)p[0]);
-     			 f->eax = mkdir((const char*)p[0]);
-      			break;
- 		case SYS_READDIR: 
-     		 	for(i=0;i<2;i++){
-			p[i] = *(uint32_t *)(f->esp+(4*(i+1)));
-			protect_user_memory((const void*)p[i]);
-			}
-    		  	f->eax = readdir((int)p[0],(char*)p[1]);
-     			 break;
-  		case SYS_ISDIR: 
-			p[0] = *(uint32_t *)(f->esp+4);
-			protect_user_memory((const void*)p[0]);
-      			f->eax = isdir((int)p[0]);
-      			break;
-  		case SYS_INUMBER: 
-			p[0] = *(uint32_t *)(f->esp+4);
-			protect_user_memory((const void*)p[0]);
-     			f->eax = inumber((int)p[0]);
-    			  break;
+static uint32_t sys_chdir (const uint32_t *a) { return chdir ((const char *) a[0]); }
+static uint32_t sys_mkdir (const uint32_t *a) { return mkdir ((const char *) a[0]); }
+static uint32_t sys_readdir (const uint32_t *a) { return readdir (a[0], (char *) a[1]); }
+static uint32_t sys_isdir (const uint32_t *a) { return isdir (a[0]); }
+static uint32_t sys_inumber (const uint32_t *a) { return inumber (a[0]); }
+static uint32_t sys_rename (const uint32_t *a) { return rename ((const char *) a[0], (const char *) a[1]); }
+static uint32_t sys_snapshot (const uint32_t *a UNUSED) { return fs_snapshot (); }
+static uint32_t sys_snapshot_read (const uint32_t *a) { return fs_snapshot_read (a[0], (void *) a[1]); }
+static uint32_t sys_snapshot_drop (const uint32_t *a UNUSED) { fs_snapshot_drop (); return 0; }
+static uint32_t sys_compress (const uint32_t *a) { return compress (a[0]); }
 #endif
-		}
-	/*	
-	printf("system call number : %u,address: %x\n",*(uint32_t*)(f->esp),(uint32_t)(f->esp));
-	printf("f->esp+4:%u\n",*(uint32_t*)(f->esp+4));
-	hex_dump((uintptr_t)(f->esp),f->esp,(0xc0000000-(uintptr_t)(f->esp)),1);
-	*/
+
+/* A system call and how to check its arguments before calling
+   it.  Pointers inside the pointed-to data, as in readv(), are
+   left to the call. */
+struct syscall_desc
+  {
+    const char *name;
+    syscall_func *func;
+    int argc;                   /* Argument words to fetch. */
+    unsigned strings;           /* Bit N set: argument N is a string. */
+    int buf;                    /* Argument that is a buffer, or -1. */
+    int len;                    /* Argument holding its size, or -1... */
+    unsigned size;              /* ...if it has this fixed size. */
+    bool write;                 /* Is the buffer filled by the call? */
+  };
+
+#define CALL(NUM, NAME, ARGC) \
+  [NUM] = { #NAME, sys_##NAME, ARGC, 0, -1, -1, 0, false }
+#define CALL_STR(NUM, NAME, ARGC, STRINGS) \
+  [NUM] = { #NAME, sys_##NAME, ARGC, STRINGS, -1, -1, 0, false }
+#define CALL_BUF(NUM, NAME, ARGC, BUF, LEN, WRITE) \
+  [NUM] = { #NAME, sys_##NAME, ARGC, 0, BUF, LEN, 0, WRITE }
+#define CALL_FIXED(NUM, NAME, ARGC, BUF, SIZE, WRITE) \
+  [NUM] = { #NAME, sys_##NAME, ARGC, 0, BUF, -1, SIZE, WRITE }
+
+static const struct syscall_desc syscalls[] =
+  {
+    CALL (SYS_HALT, halt, 0),
+    CALL (SYS_EXIT, exit, 1),
+    CALL_STR (SYS_EXEC, exec, 1, 1 << 0),
+    CALL (SYS_WAIT, wait, 1),
+    CALL_STR (SYS_CREATE, create, 2, 1 << 0),
+    CALL_STR (SYS_REMOVE, remove, 1, 1 << 0),
+    CALL_STR (SYS_OPEN, open, 1, 1 << 0),
+    CALL (SYS_FILESIZE, filesize, 1),
+    CALL_BUF (SYS_READ, read, 3, 1, 2, true),
+    CALL_BUF (SYS_WRITE, write, 3, 1, 2, false),
+    CALL (SYS_SEEK, seek, 2),
+    CALL (SYS_TELL, tell, 1),
+    CALL (SYS_CLOSE, close, 1),
+    CALL (SYS_FIBO, fibo, 1),
+    CALL (SYS_MAXFOUR, maxfour, 4),
+    CALL_BUF (SYS_PREAD, pread, 4, 1, 2, true),
+    CALL_BUF (SYS_PWRITE, pwrite, 4, 1, 2, false),
+    CALL (SYS_READV, readv, 3),
+    CALL (SYS_WRITEV, writev, 3),
+    CALL (SYS_COPY_FILE_RANGE, copy_file_range, 3),
+    CALL (SYS_RING_SETUP, ring_setup, 1),
+    CALL (SYS_RING_ENTER, ring_enter, 0),
+    CALL_STR (SYS_SPAWN, spawn, 4, 1 << 0),
+#ifdef VM
+    CALL (SYS_FORK, fork, 0),
+    CALL (SYS_MMAP, mmap, 2),
+    CALL (SYS_MUNMAP, munmap, 1),
+#endif
+#ifdef FILESYS
+    CALL_STR (SYS_CHDIR, chdir, 1, 1 << 0),
+    CALL_STR (SYS_MKDIR, mkdir, 1, 1 << 0),
+    CALL_FIXED (SYS_READDIR, readdir, 2, 1, READDIR_MAX_LEN + 1, true),
+    CALL (SYS_ISDIR, isdir, 1),
+    CALL (SYS_INUMBER, inumber, 1),
+    CALL_STR (SYS_RENAME, rename, 2, 1 << 0 | 1 << 1),
+    CALL (SYS_SNAPSHOT, snapshot, 0),
+    CALL_FIXED (SYS_SNAPSHOT_READ, snapshot_read, 2, 1, BLOCK_SECTOR_SIZE,
+                true),
+    CALL (SYS_SNAPSHOT_DROP, snapshot_drop, 0),
+    CALL (SYS_COMPRESS, compress, 1),
+#endif
+  };
+#define SYSCALL_CNT (sizeof syscalls / sizeof *syscalls)
+
+/* Calls made to and CPU cycles spent in each system call.  The
+   counters are not locked; a lost update only blurs a profile. */
+static struct
+  {
+    uint64_t calls;
+    uint64_t cycles;
+  }
+syscall_stats[SYSCALL_CNT];
+
+/* Returns the CPU's time stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Fetches the arguments of the system call at F->esp and checks
+   them as its entry in SYSCALLS says, all before calling it.
+   A bad number or pointer kills the process. */
+static void
+syscall_handler (struct intr_frame *f) 
+{
+  const struct syscall_desc *d;
+  uint32_t args[4];
+  uint64_t start = rdtsc ();
+  unsigned num;
+  int i;
+
+  thread_current()->user_esp = f->esp;
+  num = get_arg(f,0);
+  if (num >= SYSCALL_CNT || syscalls[num].func == NULL)
+    exit(-1);
+  d = &syscalls[num];
+  for (i = 0; i < d->argc; i++)
+    {
+      args[i] = get_arg(f,i+1);
+      if (d->strings & (1u << i))
+        check_user_string((const char*)args[i]);
+    }
+  if (d->buf >= 0)
+    check_user_buffer((void*)args[d->buf],
+                      d->len >= 0 ? args[d->len] : d->size, d->write);
+  f->eax = d->func(args);
+  syscall_stats[num].calls++;
+  syscall_stats[num].cycles += rdtsc () - start;
+}
+
+/* Prints the calls to and cycles spent in each system call that
+   was used. */
+void
+syscall_print_stats (void)
+{
+  size_t i;
+
+  for (i = 0; i < SYSCALL_CNT; i++)
+    if (syscall_stats[i].calls > 0)
+      printf ("Syscall %s: %llu calls, %llu cycles\n", syscalls[i].name,
+              syscall_stats[i].calls, syscall_stats[i].cycles);
 }
 void exit(int num){
 	struct thread* cur = thread_current();
@@ -189,12 +366,6 @@ void exit(int num){
 	int fd = 2;
 	thread_exit();
 }
-void protect_user_memory(const void* add){
-	if(is_user_vaddr(add)) //from threads/vaddr.h
-		return;
-	else
-		exit(-1);
-}
 void halt(void){
 	shutdown_power_off(); //from devices/shutdown.h
 }
@@ -204,6 +375,97 @@ pid_t exec(const char *cmd_line){
 int wait(pid_t pid){ 
 	return process_wait(pid);
 }
+
+/* Most fds one spawn() can hand down. */
+#define SPAWN_FDS_MAX 64
+
+/* Kills the process unless ARGV is a readable, null-terminated
+   array of readable user strings.  Returns how many there are
+   and stores their total size, nulls included, in *TLEN; stops
+   early, with *TLEN at least PGSIZE, once they can't fit in a
+   page. */
+static int check_spawn_argv(char *const *argv, size_t *tlen)
+{
+  int argc;
+
+  *tlen = 0;
+  for(argc = 0; ; argc++) {
+    check_user_buffer(argv + argc, sizeof *argv, false);
+    if(argv[argc] == NULL)
+      break;
+    check_user_string(argv[argc]);
+    *tlen += strlen(argv[argc]) + 1;
+    if(*tlen >= PGSIZE)
+      break;
+  }
+  return argc;
+}
+
+/* Lays out in the top SIZE bytes of KPAGE the initial stack of a
+   process whose ARGC arguments are the user strings in ARGV,
+   already checked by check_spawn_argv(), with pointers for its
+   place just below PHYS_BASE. */
+static void build_spawn_stack(char *const *argv, int argc, uint8_t *kpage,
+                              size_t size)
+{
+  uint8_t *top = kpage + PGSIZE, *sp = top;
+  uint32_t *words = (uint32_t *)(top - size);
+  size_t len;
+  int i;
+
+  for(i = argc - 1; i >= 0; i--) {
+    len = strlen(argv[i]) + 1;
+    sp -= len;
+    memcpy(sp, argv[i], len);
+    words[3 + i] = (uint32_t)PHYS_BASE - (top - sp);
+  }
+  memset(words + 4 + argc, 0, sp - (uint8_t *)(words + 4 + argc));
+  words[3 + argc] = 0;
+  words[2] = (uint32_t)PHYS_BASE - (top - (uint8_t *)(words + 3));
+  words[1] = argc;
+  words[0] = 0;
+}
+
+/* Starts FILE with the arguments in ARGV, built straight into
+   its stack, and the FD_CNT open fds in FDS under the same
+   numbers.  Returns -1 at once if it cannot be loaded. */
+pid_t spawn(const char *file, char *const argv[], const int *fds, int fd_cnt)
+{
+  int kfds[SPAWN_FDS_MAX];
+  uint8_t *kpage;
+  size_t flen, tlen, size;
+  int argc;
+  pid_t pid;
+
+  // every check that can kill the process comes before the page is
+  // allocated, or a bad pointer would leak it
+  if(fd_cnt < 0 || fd_cnt > SPAWN_FDS_MAX)
+    return -1;
+  check_user_buffer(fds, fd_cnt * sizeof *fds, false);
+  memcpy(kfds, fds, fd_cnt * sizeof *fds);
+  check_user_string(file);
+  argc = check_spawn_argv(argv, &tlen);
+  if(tlen >= PGSIZE)
+    return -1;
+  /* Strings, padding, argv[] with its null, then argv, argc and
+     a null return address. */
+  size = ROUND_UP(tlen, 4) + (argc + 4) * sizeof(uint32_t);
+  flen = strlen(file) + 1;
+  if(flen >= PGSIZE || size > PGSIZE - flen)
+    return -1;
+
+  kpage = palloc_get_page(0);
+  if(kpage == NULL)
+    return -1;
+  // the child loads FILE in its own address space, so it gets a copy
+  // at the bottom of the page, below the stack
+  memcpy(kpage, file, flen);
+  build_spawn_stack(argv, argc, kpage, size);
+  pid = process_spawn((const char *)kpage, kpage + PGSIZE - size, size,
+                      kfds, fd_cnt);
+  palloc_free_page(kpage);
+  return pid;
+}
 #ifdef FILESYS
 bool chdir(const char *filename)
 {
@@ -237,15 +499,53 @@ int inumber(int fd)
   struct Fd* fcur = get_file(fd, F | D);
   return (int) inode_get_inumber (file_get_inode(fcur->file));
 }
+bool rename(const char *old, const char *new)
+{
+  return filesys_rename(old, new);
+}
+bool fs_snapshot(void)
+{
+  return snapshot_create();
+}
+bool fs_snapshot_read(unsigned sector, void *buffer)
+{
+  // read into a kernel buffer so a bad user pointer faults outside the snapshot lock
+  void *bounce = malloc(BLOCK_SECTOR_SIZE);
+  bool success;
+  if (bounce == NULL)
+    return false;
+  success = snapshot_read(sector, bounce);
+  if (success)
+    memcpy(buffer, bounce, BLOCK_SECTOR_SIZE);
+  free(bounce);
+  return success;
+}
+void fs_snapshot_drop(void)
+{
+  snapshot_drop();
+}
+bool compress(int fd)
+{
+  struct Fd* fcur = get_file(fd, F);
+  bool success;
+  if (fcur == NULL)
+    return false;
+  lock_acquire (&w);
+  success = inode_set_compressed(file_get_inode(fcur->file));
+  lock_release (&w);
+  return success;
+}
 #endif
 int read(int fd,void* buffer,unsigned size){//pj1 only for stdin(0)
   struct Fd* fcur;
   int rbytes,cur;
-  lock_acquire (&w);
   if(fd != 0) { 
     fcur = get_file(fd, F);
-    if(fcur != NULL && fcur->file != NULL)
+    if(fcur != NULL && fcur->file != NULL) {
+      file_lock(fcur->file);
       rbytes = file_read(fcur->file, buffer, size);
+      file_unlock(fcur->file);
+    }
     else 
       rbytes = -1;
   }
@@ -258,17 +558,18 @@ int read(int fd,void* buffer,unsigned size){//pj1 only for stdin(0)
     }
     rbytes = --cur;
   }
-  lock_release (&w);
   return rbytes;
 }
 int write(int fd,const void* buffer,unsigned size){ //pj1 only for stdout(1)
  struct Fd* fcur; 
  int wbytes;
- lock_acquire (&w);
   if(fd != 1) { 
     fcur = get_file( fd, F);
-    if(fcur && fcur->file) 
+    if(fcur && fcur->file) {
+      file_lock(fcur->file);
       wbytes = file_write(fcur->file, buffer, size);
+      file_unlock(fcur->file);
+    }
     else 
       wbytes = -1;
   }
@@ -276,9 +577,281 @@ int write(int fd,const void* buffer,unsigned size){ //pj1 only for stdout(1)
     putbuf(buffer, size);
     wbytes = (int)size;
   }
-  lock_release (&w);
   return wbytes;
 }
+/* Like read and write, but at OFFSET instead of the file
+   position, which is left alone. */
+int pread(int fd,void* buffer,unsigned size,unsigned offset){
+  struct Fd* fcur;
+  int rbytes;
+  if((off_t)offset < 0)
+    return -1;
+  fcur = get_file(fd, F);
+  if(fcur != NULL && fcur->file != NULL)
+    rbytes = file_read_at(fcur->file, buffer, size, offset);
+  else
+    rbytes = -1;
+  return rbytes;
+}
+int pwrite(int fd,const void* buffer,unsigned size,unsigned offset){
+  struct Fd* fcur;
+  int wbytes;
+  if((off_t)offset < 0)
+    return -1;
+  fcur = get_file(fd, F);
+  if(fcur != NULL && fcur->file != NULL)
+    wbytes = file_write_at(fcur->file, buffer, size, offset);
+  else
+    wbytes = -1;
+  return wbytes;
+}
+/* Copies the IOVCNT buffers at IOV into the kernel and checks
+   that they are user memory that can be read, or written if
+   WRITE.  Stores the total length in *TOTAL.  Returns NULL if the
+   list is invalid or too long. */
+static struct iovec* copy_iovec(const struct iovec* iov,int iovcnt,bool write,off_t* total){
+  struct iovec* kiov;
+  int i;
+  if(iovcnt < 0 || iovcnt > IOV_MAX)
+    return NULL;
+  check_user_buffer(iov, iovcnt * sizeof *iov, false);
+  *total = 0;
+  for(i=0;i<iovcnt;i++){
+    check_user_buffer(iov[i].iov_base, iov[i].iov_len, write);
+    if(iov[i].iov_len > (size_t)(INT32_MAX - *total))
+      return NULL;
+    *total += iov[i].iov_len;
+  }
+  kiov = malloc(iovcnt * sizeof *kiov + 1);   // malloc(0) fails
+  if(kiov != NULL)
+    memcpy(kiov, iov, iovcnt * sizeof *kiov);
+  return kiov;
+}
+/* Reads into the IOVCNT buffers of IOV in order, as one read
+   would: stops early at end of file. */
+int readv(int fd,const struct iovec* iov,int iovcnt){
+  struct iovec* kiov;
+  struct Fd* fcur = NULL;
+  off_t total;
+  int i,n,rbytes = 0;
+  size_t j;
+  kiov = copy_iovec(iov, iovcnt, true, &total);
+  if(kiov == NULL)
+    return -1;
+  if(fd != 0) {
+    fcur = get_file(fd, F);
+    if(fcur == NULL || fcur->file == NULL)
+      rbytes = -1;
+    else
+      file_lock(fcur->file);
+  }
+  for(i=0;i<iovcnt && rbytes >= 0;i++){
+    if(fd == 0) {
+      for(j=0;j<kiov[i].iov_len;j++)
+        ((uint8_t*)kiov[i].iov_base)[j] = input_getc();
+      n = kiov[i].iov_len;
+    }
+    else
+      n = file_read(fcur->file, kiov[i].iov_base, kiov[i].iov_len);
+    rbytes += n;
+    if((size_t)n < kiov[i].iov_len)
+      break;
+  }
+  if(fcur != NULL && rbytes >= 0)
+    file_unlock(fcur->file);
+  free(kiov);
+  return rbytes;
+}
+/* Writes the IOVCNT buffers of IOV in order, as one write would.
+   The file is grown once up front, not once per buffer, and its
+   position lock is held throughout so the buffers stay together. */
+int writev(int fd,const struct iovec* iov,int iovcnt){
+  struct iovec* kiov;
+  struct Fd* fcur = NULL;
+  off_t total;
+  int i,n,wbytes = 0;
+  kiov = copy_iovec(iov, iovcnt, false, &total);
+  if(kiov == NULL)
+    return -1;
+  if(fd != 1) {
+    fcur = get_file(fd, F);
+    if(fcur == NULL || fcur->file == NULL)
+      wbytes = -1;
+    else {
+      file_lock(fcur->file);
+      if(!file_extend(fcur->file, file_tell(fcur->file) + total))
+        iovcnt = 0;           // can't grow: nothing is written
+    }
+  }
+  for(i=0;i<iovcnt && wbytes >= 0;i++){
+    if(fd == 1) {
+      putbuf(kiov[i].iov_base, kiov[i].iov_len);
+      n = kiov[i].iov_len;
+    }
+    else
+      n = file_write(fcur->file, kiov[i].iov_base, kiov[i].iov_len);
+    wbytes += n;
+    if((size_t)n < kiov[i].iov_len)
+      break;
+  }
+  if(fcur != NULL && wbytes >= 0)
+    file_unlock(fcur->file);
+  free(kiov);
+  return wbytes;
+}
+/* Copies SIZE bytes from FD_IN to FD_OUT, each at its file
+   position, without passing through user memory.  Overlapping
+   ranges of one file are refused. */
+int copy_file_range(int fd_in,int fd_out,unsigned size){
+  struct Fd *in,*out;
+  struct file *first,*second;
+  off_t in_pos,out_pos;
+  int cbytes = -1;
+  if((off_t)size < 0)
+    return -1;
+  in = get_file(fd_in, F);
+  out = get_file(fd_out, F);
+  if(in == NULL || out == NULL)
+    return -1;
+  // lock in address order so two opposite copies can't deadlock
+  first = in->file < out->file ? in->file : out->file;
+  second = in->file < out->file ? out->file : in->file;
+  file_lock(first);
+  if(second != first)
+    file_lock(second);
+  in_pos = file_tell(in->file);
+  out_pos = file_tell(out->file);
+  // nothing past the end of the input is copied; the overlap test is
+  // done in 64 bits so a huge size can't wrap it
+  if(in_pos >= file_length(in->file))
+    size = 0;
+  else if(size > (unsigned)(file_length(in->file) - in_pos))
+    size = file_length(in->file) - in_pos;
+  if(file_get_inode(in->file) != file_get_inode(out->file)
+     || (uint64_t)in_pos + size <= (uint64_t)out_pos
+     || (uint64_t)out_pos + size <= (uint64_t)in_pos)
+    cbytes = file_copy(out->file, in->file, size);
+  if(second != first)
+    file_unlock(second);
+  file_unlock(first);
+  return cbytes;
+}
+/* Makes RING the current process's syscall ring, or drops the
+   ring if RING is null. */
+bool ring_setup(struct sys_ring* ring){
+  if(ring != NULL)
+    check_user_buffer(ring, sizeof *ring, true);
+  thread_current()->ring = ring;
+  return true;
+}
+/* Runs one ring request, checking its pointers as the system
+   call itself would. */
+static int ring_run(const struct ring_sqe* sqe){
+  switch(sqe->op){
+    case RING_READ:
+      check_user_buffer(sqe->buf, sqe->size, true);
+      return read(sqe->fd, sqe->buf, sqe->size);
+    case RING_WRITE:
+      check_user_buffer(sqe->buf, sqe->size, false);
+      return write(sqe->fd, sqe->buf, sqe->size);
+    case RING_PREAD:
+      check_user_buffer(sqe->buf, sqe->size, true);
+      return pread(sqe->fd, sqe->buf, sqe->size, sqe->offset);
+    case RING_OPEN:
+      check_user_string(sqe->buf);
+      return open(sqe->buf);
+    case RING_CLOSE:
+      if(get_file(sqe->fd, F | D) == NULL)
+        return -1;
+      close(sqe->fd);
+      return 0;
+    default:
+      return -1;
+  }
+}
+/* Runs the requests queued in the current process's ring in
+   order and posts their completions, stopping early if the
+   completion queue is full.  Returns the number of requests run,
+   or -1 if there is no ring. */
+int ring_enter(void){
+  struct sys_ring* r = thread_current()->ring;
+  struct ring_sqe sqe;
+  struct ring_cqe* cqe;
+  int done = 0;
+  if(r == NULL)
+    return -1;
+  check_user_buffer(r, sizeof *r, true);
+  while(r->sq_head != r->sq_tail && r->cq_tail - r->cq_head < RING_ENTRIES){
+    sqe = r->sq[r->sq_head % RING_ENTRIES];
+    cqe = &r->cq[r->cq_tail % RING_ENTRIES];
+    cqe->res = ring_run(&sqe);
+    cqe->user_data = sqe.user_data;
+    r->sq_head++;
+    r->cq_tail++;
+    done++;
+  }
+  return done;
+}
+#ifdef VM
+pid_t fork(void){
+  return process_fork();
+}
+/* Maps the file open as FD at ADDR.  Pages are only recorded
+   here; the page fault handler reads each one on first touch. */
+mapid_t mmap(int fd, void* addr){
+  struct thread* t = thread_current();
+  struct Fd* fcur = get_file(fd, F);
+  struct mapping* m;
+  off_t len, ofs;
+  if(fcur == NULL || addr == NULL || pg_ofs(addr) != 0)
+    return MAP_FAILED;
+  len = file_length(fcur->file);
+  if(len == 0)
+    return MAP_FAILED;
+  m = malloc(sizeof *m);
+  if(m == NULL)
+    return MAP_FAILED;
+  m->file = file_reopen(fcur->file);
+  m->addr = addr;
+  m->page_cnt = 0;
+  if(m->file == NULL) {
+    free(m);
+    return MAP_FAILED;
+  }
+  m->id = t->next_mapid++;
+  list_push_back(&t->mmaps, &m->elem);
+  for(ofs = 0; ofs < len; ofs += PGSIZE) {
+    size_t read_bytes = len - ofs < PGSIZE ? len - ofs : PGSIZE;
+    if(!is_user_vaddr((uint8_t*)addr + ofs)
+       || !page_add_file((uint8_t*)addr + ofs, m->file, ofs, read_bytes,
+                         true, true)) {
+      munmap(m->id);
+      return MAP_FAILED;
+    }
+    m->page_cnt++;
+  }
+  return m->id;
+}
+/* Removes mapping MAPID, writing back the pages that were
+   modified. */
+void munmap(mapid_t mapid){
+  struct thread* t = thread_current();
+  struct list_elem* e;
+  struct mapping* m;
+  size_t i;
+  for(e = list_begin(&t->mmaps); e != list_end(&t->mmaps); e = list_next(e)) {
+    m = list_entry(e, struct mapping, elem);
+    if(m->id != mapid)
+      continue;
+    for(i = 0; i < m->page_cnt; i++)
+      page_remove(page_lookup((uint8_t*)m->addr + i * PGSIZE));
+    list_remove(&m->elem);
+    file_close(m->file);
+    free(m);
+    return;
+  }
+}
+#endif
 int fibonacci(int n){
 	int i,f1=1,f2=1,res=2;
 	if(n == 1)
@@ -310,15 +883,15 @@ bool remove(const char*file){ /*deletes the file called file*/
 int open(const char*file){/*opens the file called file*/
   struct thread* cur = thread_current();
   struct file* fnew;
-  struct list* fhead;
   struct inode* id;
-  struct Fd* fcur = palloc_get_page(0);
+  int fd;
+  struct Fd* fcur = malloc(sizeof *fcur);
   if (fcur == NULL)
     return -1;
   lock_acquire (&w);
   fnew = filesys_open(file);
   if (fnew == NULL) {
-    palloc_free_page(fcur);
+    free(fcur);
     lock_release (&w);
     return -1;
   }
@@ -330,14 +903,15 @@ int open(const char*file){/*opens the file called file*/
     fcur->dir = dir_open(inode_reopen(id));
   else 
     fcur->dir = NULL;
-  fhead = &cur->fd_head;
-  if (list_empty(fhead))
-    fcur->num = 3;
-  else
-    fcur->num = (list_entry(list_back(fhead),struct Fd,elem)->num) + 1;
-  list_push_back(fhead, &(fcur->elem));
+  fd = alloc_fd(fcur);
+  if (fd < 0) {
+    if(fcur->dir)
+      dir_close(fcur->dir);
+    file_close(fnew);
+    free(fcur);
+  }
   lock_release (&w);
-  return fcur->num;
+  return fd;
 }
 int filesize(int fd){/*returns the size*/
   struct Fd* fcur = get_file(fd,F);
@@ -347,8 +921,11 @@ int filesize(int fd){/*returns the size*/
 }
 void seek(int fd,unsigned position){/*changes the next byte to be read or written*/
   struct Fd* fcur = get_file(fd, F);
-  if(fcur != NULL && fcur->file != NULL)
+  if(fcur != NULL && fcur->file != NULL) {
+    file_lock(fcur->file);
     file_seek(fcur->file, position);
+    file_unlock(fcur->file);
+  }
   return; 
 }
 unsigned tell(int fd){/*returns the position of the next byte to be read or written*/
@@ -364,8 +941,9 @@ void close(int fd){/*close file descriptor fd*/
     file_close(fcur->file);
     if(fcur->dir) 
 	    dir_close(fcur->dir);
-    list_remove(&(fcur->elem));
-    palloc_free_page(fcur);
+    thread_current()->fds[fd] = NULL;
+    bitmap_reset(thread_current()->fd_used, fd);
+    free(fcur);
   }
   else
 	  exit(-1);
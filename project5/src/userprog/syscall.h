@@ -3,8 +3,8 @@
 #include "threads/thread.h"
 #include "lib/user/syscall.h"
 void syscall_init (void);
+void syscall_print_stats (void);
 
-void protect_user_memory(const void* add);
 void exit(int num);
 void halt(void);
 pid_t exec(const char *cmd_line);
@@ -13,6 +13,13 @@ int read(int fd,void* buffer,unsigned size);
 int write(int fd,const void* buffer,unsigned size);
 int fibonacci(int n);
 int max_of_four_int(int a,int b,int c,int d);
+int pread(int fd,void* buffer,unsigned size,unsigned offset);
+int pwrite(int fd,const void* buffer,unsigned size,unsigned offset);
+int readv(int fd,const struct iovec* iov,int iovcnt);
+int writev(int fd,const struct iovec* iov,int iovcnt);
+int copy_file_range(int fd_in,int fd_out,unsigned size);
+bool ring_setup(struct sys_ring* ring);
+int ring_enter(void);
 /*---belows are pj2---*/
 bool create(const char*file,unsigned initial_size);
 bool remove(const char*file);
@@ -23,7 +30,6 @@ unsigned tell(int fd);
 void close(int fd);
 struct lock mut,w,filesys_lock;
 struct Fd {
-  struct list_elem elem;
   struct file* file;
   struct dir* dir;       
   int num;
@@ -34,5 +40,10 @@ bool mkdir(const char *filename);
 bool readdir(int fd, char *filename);
 bool isdir(int fd);
 int inumber(int fd);
+bool rename(const char *old, const char *new);
+bool fs_snapshot(void);
+bool fs_snapshot_read(unsigned sector, void *buffer);
+void fs_snapshot_drop(void);
+bool compress(int fd);
 #endif
 #endif /* userprog/syscall.h */
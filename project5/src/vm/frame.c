@@ -1,5 +1,6 @@
 #include "vm/frame.h"
 #include <stdio.h>
+#include <string.h>
 #include <bitmap.h>
 #include <round.h>
 #include "vm/page.h"
@@ -15,16 +16,34 @@
 static struct bitmap *free_frames;
 static struct frame_entry *frame_table;
 static unsigned clock_ptr, clock_max;
+static struct hash shared_frames;   /* Shared frames by file bytes. */
 
 static struct lock frame_lock;
+static struct condition written_back; /* A page's evicting went false. */
+static struct condition frame_loaded; /* A shared frame finished loading. */
 
+static unsigned shared_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame_entry *f = hash_entry (e, struct frame_entry, share_elem);
+  return hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->offset);
+}
+
+static bool shared_less (const struct hash_elem *a_, const struct hash_elem *b_,
+                         void *aux UNUSED)
+{
+  const struct frame_entry *a = hash_entry (a_, struct frame_entry, share_elem);
+  const struct frame_entry *b = hash_entry (b_, struct frame_entry, share_elem);
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->offset != b->offset)
+    return a->offset < b->offset;
+  return a->read_bytes < b->read_bytes;
+}
+
+/* USER_PAGES is the size of palloc's user pool. */
 void frame_init (size_t user_pages)
 {
   unsigned i;
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (user_pages), PGSIZE);
-  if (bm_pages > user_pages)
-    bm_pages = user_pages;
-  user_pages -= bm_pages;
 
   clock_ptr = 0;
   clock_max = (unsigned) user_pages;
@@ -32,51 +51,233 @@ void frame_init (size_t user_pages)
   free_frames = bitmap_create(user_pages);
   for(i = 0; i < user_pages; i++) {
     frame_table[i].num = i;
+    frame_table[i].kpage = NULL;
     frame_table[i].page_occupant = NULL;
+    frame_table[i].refs = 0;
+    frame_table[i].loading = false;
+    list_init (&frame_table[i].sharers);
   }
+  hash_init (&shared_frames, shared_hash, shared_less, NULL);
 
   lock_init (&frame_lock);
+  cond_init (&written_back);
+  cond_init (&frame_loaded);
+}
+
+/* Returns true if P, just unmapped from its frame, must be
+   written back to its file: it is part of a mapping and the
+   process has modified it.  Callers unmap the page first, so the
+   process cannot dirty it again; clearing the page keeps its
+   dirty bit. */
+static bool needs_write_back (struct page *p)
+{
+  return p->mmapped && pagedir_is_dirty (p->pagedir, p->addr);
+}
+
+/* Writes KPAGE, the last contents of P, back to P's file.  File
+   I/O takes file system locks, under which the kernel may touch
+   user pages and fault, so it is never done under frame_lock:
+   the lock is dropped around the write and held again after. */
+static void write_back (struct page *p, void *kpage)
+{
+  lock_release (&frame_lock);
+  file_write_at (p->file, kpage, p->read_bytes, p->offset);
+  lock_acquire (&frame_lock);
+}
+
+/* Waits, with frame_lock held, until no eviction is writing P
+   back. */
+static void wait_written_back (struct page *p)
+{
+  while (p->evicting)
+    cond_wait (&written_back, &frame_lock);
 }
-void free_frame (struct frame_entry *f)
+
+/* Waits until no eviction is writing P back, so that reading P
+   from its file sees what the process last wrote to it. */
+void frame_wait (struct page *p)
 {
   lock_acquire (&frame_lock);
-  pagedir_clear_page (f->page_occupant->pagedir, f->page_occupant->addr);
+  wait_written_back (p);
+  lock_release (&frame_lock);
+}
+
+/* Returns F to the user pool.  frame_lock must be held. */
+static void release_frame (struct frame_entry *f)
+{
   bitmap_reset (free_frames, f->num);
-  palloc_free_page (frame_table[f->num].kpage);
+  palloc_free_page (f->kpage);
+  f->kpage = NULL;
   f->page_occupant = NULL;
-  lock_release (&frame_lock);
 }
 
-struct frame_entry * frame_get_multiple (size_t page_cnt)
+/* Hands copy-on-write frame F, now down to one sharer, to that
+   page as a private frame, writable again if the page is. */
+static void make_private (struct frame_entry *f)
 {
+  struct page *p = list_entry (list_pop_front (&f->sharers),
+                               struct page, share_elem);
+  f->refs = 0;
+  f->page_occupant = p;
+  if (p->writable) {
+    pagedir_clear_page (p->pagedir, p->addr);
+    pagedir_set_page (p->pagedir, p->addr, f->kpage, true);
+  }
+}
+
+/* Releases the frame holding P, if it still has one.  A shared
+   frame is released with its last sharer. */
+void free_frame (struct page *p)
+{
+  struct frame_entry *f;
   lock_acquire (&frame_lock);
-  size_t fnum = bitmap_scan_and_flip (free_frames, 0, page_cnt, false);
-  if(fnum != BITMAP_ERROR) {
-    frame_table[fnum].kpage = palloc_get_page(PAL_USER | PAL_ASSERT | PAL_ZERO);
-    lock_release (&frame_lock);
-    return &frame_table[fnum];
+  wait_written_back (p);
+  f = p->frame;
+  if (f != NULL) {
+    pagedir_clear_page (p->pagedir, p->addr);
+    p->frame = NULL;
+    if (f->refs > 0) {
+      list_remove (&p->share_elem);
+      if (--f->refs == 0) {
+        hash_delete (&shared_frames, &f->share_elem);
+        release_frame (f);
+      }
+      else if (f->refs == 1 && f->inode == NULL)
+        make_private (f);
+    }
+    else {
+      /* With no occupant, F is not evicted during the write. */
+      f->page_occupant = NULL;
+      if (needs_write_back (p))
+        write_back (p, f->kpage);
+      release_frame (f);
+    }
   }
-  else {
-    struct thread *t = thread_current ();
-    while (pagedir_is_accessed (t->pagedir, frame_table[clock_ptr].page_occupant->addr))
-    {
-      pagedir_set_accessed (t->pagedir, frame_table[clock_ptr].page_occupant->addr, false);
-      clock_ptr++;
-      if(clock_ptr >= clock_max)
-        clock_ptr = 0;
+  lock_release (&frame_lock);
+}
+
+/* Returns true if any process sharing F used it since the last
+   sweep, and clears all their accessed bits. */
+static bool shared_accessed (struct frame_entry *f)
+{
+  struct list_elem *e;
+  bool accessed = false;
+  for (e = list_begin (&f->sharers); e != list_end (&f->sharers);
+       e = list_next (e)) {
+    struct page *p = list_entry (e, struct page, share_elem);
+    if (pagedir_is_accessed (p->pagedir, p->addr)) {
+      pagedir_set_accessed (p->pagedir, p->addr, false);
+      accessed = true;
     }
-    swap_insert (frame_table[clock_ptr].page_occupant);
-    frame_table[clock_ptr].page_occupant->frame = NULL;
-    frame_table[clock_ptr].page_occupant->status = IN_SWAP_TABLE;
-    pagedir_clear_page (frame_table[clock_ptr].page_occupant->pagedir, frame_table[clock_ptr].page_occupant->addr);
-    
-    unsigned clock_prev = clock_ptr;
+  }
+  return accessed;
+}
+
+/* Unmaps shared frame F from every sharer.  They read the page
+   from the file again on their next touch. */
+static void unshare (struct frame_entry *f)
+{
+  while (!list_empty (&f->sharers)) {
+    struct page *p = list_entry (list_pop_front (&f->sharers),
+                                 struct page, share_elem);
+    pagedir_clear_page (p->pagedir, p->addr);
+    p->frame = NULL;
+    p->status = IN_FILESYS;
+  }
+  hash_delete (&shared_frames, &f->share_elem);
+  f->refs = 0;
+}
+
+/* Picks a victim with the clock algorithm and empties it: mapped
+   file pages go back to their file, read-only executable pages
+   are dropped to be read again, and others go to swap.  Frames
+   whose page is still being loaded have no occupant and are
+   skipped.  A modified mapped page is not written here but
+   stored into *DIRTY, marked evicting, for the caller to write
+   back; otherwise *DIRTY is null.  Returns null if no frame can
+   be evicted. */
+static struct frame_entry * evict (struct page **dirty)
+{
+  *dirty = NULL;
+  unsigned tries;
+  for (tries = 0; tries < 2 * clock_max; tries++) {
+    struct frame_entry *f = &frame_table[clock_ptr];
+    struct page *p = f->page_occupant;
     clock_ptr++;
     if(clock_ptr >= clock_max)
-        clock_ptr = 0;
-    lock_release (&frame_lock);
-    return &frame_table[clock_prev];
+      clock_ptr = 0;
+    if (f->refs > 0) {
+      /* Copy-on-write frames stay until a write or exit splits
+         them; their sharers could not all read them back. */
+      if (f->inode == NULL || shared_accessed (f))
+        continue;
+      unshare (f);
+      return f;
+    }
+    if (p == NULL)
+      continue;
+    if (pagedir_is_accessed (p->pagedir, p->addr)) {
+      pagedir_set_accessed (p->pagedir, p->addr, false);
+      continue;
+    }
+    pagedir_clear_page (p->pagedir, p->addr);
+    if (p->mmapped) {
+      if (needs_write_back (p)) {
+        p->evicting = true;
+        *dirty = p;
+      }
+      p->status = IN_FILESYS;
+    }
+    else if (p->file != NULL && !p->writable)
+      p->status = p->read_bytes > 0 ? IN_FILESYS : ALL_ZERO;
+    else {
+      swap_insert (p);
+      p->status = IN_SWAP_TABLE;
+    }
+    p->frame = NULL;
+    f->page_occupant = NULL;
+    return f;
+  }
+  return NULL;
+}
+
+/* Returns a frame with no occupant, evicting one if the user pool
+   is full.  frame_lock must be held; it is dropped and taken
+   again if the victim has to be written back first, so callers
+   must not rely on state they saw before the call. */
+static struct frame_entry * alloc_frame (void)
+{
+  struct frame_entry *f = NULL;
+  struct page *dirty;
+  size_t fnum = bitmap_scan_and_flip (free_frames, 0, 1, false);
+  if(fnum != BITMAP_ERROR) {
+    frame_table[fnum].kpage = palloc_get_page(PAL_USER | PAL_ZERO);
+    if (frame_table[fnum].kpage != NULL)
+      f = &frame_table[fnum];
+    else
+      bitmap_reset (free_frames, fnum);
+  }
+  if (f == NULL) {
+    f = evict (&dirty);
+    if (dirty != NULL) {
+      write_back (dirty, f->kpage);
+      dirty->evicting = false;
+      cond_broadcast (&written_back, &frame_lock);
+    }
   }
+  return f;
+}
+
+/* Returns a frame with no occupant.  The caller fills it and then
+   sets page_occupant, which makes it a candidate for eviction. */
+struct frame_entry * frame_get_multiple (size_t page_cnt)
+{
+  struct frame_entry *f;
+  ASSERT (page_cnt == 1);
+  lock_acquire (&frame_lock);
+  f = alloc_frame ();
+  lock_release (&frame_lock);
+  return f;
 }
 
 struct frame_entry * get_frame ()
@@ -84,3 +285,145 @@ struct frame_entry * get_frame ()
   return frame_get_multiple (1);
 }
 
+/* Maps P, a read-only page of an executable, to the frame that
+   already holds the same bytes of the same inode, reading them
+   into a new frame if no process has them yet.  The read is done
+   without frame_lock: the new frame goes into the shared frame
+   table marked loading, and other processes after the same bytes
+   wait for it there.  Returns false if no frame is free or the
+   read fails. */
+bool frame_map_shared (struct page *p)
+{
+  struct frame_entry key, *f = NULL;
+  struct hash_elem *e;
+  bool ok;
+
+  key.inode = file_get_inode (p->file);
+  key.offset = p->offset;
+  key.read_bytes = p->read_bytes;
+  lock_acquire (&frame_lock);
+  for (;;) {
+    e = hash_find (&shared_frames, &key.share_elem);
+    if (e != NULL) {
+      f = hash_entry (e, struct frame_entry, share_elem);
+      if (!f->loading)
+        break;
+      /* Look again afterward: the read may have failed. */
+      cond_wait (&frame_loaded, &frame_lock);
+      continue;
+    }
+    f = alloc_frame ();
+    if (f == NULL)
+      goto fail;
+    if (hash_find (&shared_frames, &key.share_elem) != NULL) {
+      /* Another process got there while alloc_frame() wrote back
+         a victim. */
+      release_frame (f);
+      continue;
+    }
+    f->inode = key.inode;
+    f->offset = key.offset;
+    f->read_bytes = key.read_bytes;
+    f->loading = true;
+    hash_insert (&shared_frames, &f->share_elem);
+    lock_release (&frame_lock);
+
+    ok = (file_read_at (p->file, f->kpage, p->read_bytes, p->offset)
+          == (off_t) p->read_bytes);
+    memset ((uint8_t *) f->kpage + p->read_bytes, 0,
+            PGSIZE - p->read_bytes);
+
+    lock_acquire (&frame_lock);
+    f->loading = false;
+    cond_broadcast (&frame_loaded, &frame_lock);
+    if (!ok) {
+      hash_delete (&shared_frames, &f->share_elem);
+      release_frame (f);
+      goto fail;
+    }
+    break;
+  }
+  if (!pagedir_set_page (p->pagedir, p->addr, f->kpage, false)) {
+    if (f->refs == 0) {
+      hash_delete (&shared_frames, &f->share_elem);
+      release_frame (f);
+    }
+    goto fail;
+  }
+  f->refs++;
+  list_push_back (&f->sharers, &p->share_elem);
+  p->frame = f;
+  p->status = IN_FRAME_TABLE;
+  lock_release (&frame_lock);
+  return true;
+
+ fail:
+  lock_release (&frame_lock);
+  return false;
+}
+
+/* Lets CHILD, the copy of PARENT made by fork(), share the frame
+   that holds PARENT.  A private frame becomes copy-on-write: both
+   pages are mapped read-only until one of them is written.
+   Returns false, doing nothing, if PARENT is not in a frame or
+   CHILD cannot be mapped. */
+bool frame_fork (struct page *parent, struct page *child)
+{
+  struct frame_entry *f;
+  bool shared = false;
+  lock_acquire (&frame_lock);
+  f = parent->frame;
+  if (f != NULL
+      && pagedir_set_page (child->pagedir, child->addr, f->kpage, false)) {
+    if (f->refs == 0) {
+      f->page_occupant = NULL;
+      f->inode = NULL;
+      list_push_back (&f->sharers, &parent->share_elem);
+      f->refs = 1;
+      if (parent->writable) {
+        pagedir_clear_page (parent->pagedir, parent->addr);
+        pagedir_set_page (parent->pagedir, parent->addr, f->kpage, false);
+      }
+    }
+    list_push_back (&f->sharers, &child->share_elem);
+    f->refs++;
+    child->frame = f;
+    child->status = IN_FRAME_TABLE;
+    shared = true;
+  }
+  lock_release (&frame_lock);
+  return shared;
+}
+
+/* Handles a write to P, a writable page in a copy-on-write frame,
+   by giving P its own copy of the frame.  Returns false if P is
+   not copy-on-write or no frame is free. */
+bool frame_unshare (struct page *p)
+{
+  struct frame_entry *f, *copy;
+  bool success = false;
+  lock_acquire (&frame_lock);
+  f = p->frame;
+  if (f != NULL && f->refs > 1 && f->inode == NULL) {
+    copy = alloc_frame ();
+    if (copy != NULL && f->refs == 0) {
+      /* The other sharers let go while alloc_frame() wrote back a
+         victim, and make_private() handed P the frame. */
+      release_frame (copy);
+      success = true;
+    }
+    else if (copy != NULL) {
+      memcpy (copy->kpage, f->kpage, PGSIZE);
+      list_remove (&p->share_elem);
+      if (--f->refs == 1)
+        make_private (f);
+      pagedir_clear_page (p->pagedir, p->addr);
+      pagedir_set_page (p->pagedir, p->addr, copy->kpage, true);
+      copy->page_occupant = p;
+      p->frame = copy;
+      success = true;
+    }
+  }
+  lock_release (&frame_lock);
+  return success;
+}
@@ -1,12 +1,20 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 #include <stdint.h>
+#include <hash.h>
+#include <list.h>
 #include "vm/page.h"
 
+struct page;
+
 void frame_init (size_t);
 struct frame_entry *get_frame (void);
 struct frame_entry *frame_get_multiple (size_t);
-void free_frame (struct frame_entry *);
+void free_frame (struct page *);
+bool frame_map_shared (struct page *);
+bool frame_fork (struct page *, struct page *);
+bool frame_unshare (struct page *);
+void frame_wait (struct page *);
 static struct bitmap *free_frames;
 static struct frame_entry *frame_table;
 static unsigned clock_ptr, clock_max;
@@ -14,7 +22,19 @@ static struct lock frame_lock;
 struct frame_entry {
     void *kpage;              
     uint32_t num;             
-    struct page *page_occupant;     
+    struct page *page_occupant;     /* Private page in the frame, or null. */
+
+    /* A read-only executable page is shared by every process
+       mapping the same bytes of the same inode.  After fork(),
+       parent and child share their pages copy-on-write; those
+       frames have a null INODE. */
+    int refs;                       /* Pages sharing the frame, or 0. */
+    struct list sharers;            /* Those pages, by share_elem. */
+    struct inode *inode;            /* File the bytes come from. */
+    off_t offset;                   /* Their offset in INODE. */
+    size_t read_bytes;              /* Bytes read; the rest is zero. */
+    bool loading;                   /* Still being read from INODE. */
+    struct hash_elem share_elem;    /* In the shared frame table. */
 };
 
 #endif /* vm/frame.h */
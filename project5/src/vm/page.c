@@ -4,6 +4,8 @@
 #include "threads/malloc.h"
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include "userprog/pagedir.h"
 #include "vm/swap.h"
 
 
@@ -34,13 +36,165 @@ struct page *page_lookup (void *address)
 void page_destructor (struct hash_elem *e, void *aux UNUSED)
 {
   struct page *p = hash_entry (e, struct page, hash_elem);
-  if (p->frame != NULL) {
-    struct frame_entry *f = p->frame;
-    p->frame = NULL;
-    free_frame (f);
-  }
+  free_frame (p);
   if (p->block_sector != -1)
     swap_free (p);
   free (p);
 }
 
+void sup_page_init (void)
+{
+  hash_init (&thread_current ()->sup_pages, page_hash, page_less, NULL);
+}
+
+/* Frees every page of the current process, writing mapped pages
+   back first.  Must run before the page directory is destroyed. */
+void sup_page_destroy (void)
+{
+  hash_destroy (&thread_current ()->sup_pages, page_destructor);
+}
+
+/* Records that user page UPAGE holds READ_BYTES bytes of FILE
+   starting at OFS, followed by zeros.  Nothing is read until the
+   page is first touched.  If MMAPPED, modified contents go back
+   to FILE instead of swap.  Returns false if UPAGE is in use. */
+bool page_add_file (void *upage, struct file *file, off_t ofs,
+                    size_t read_bytes, bool writable, bool mmapped)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  if (page_lookup (upage) != NULL
+      || pagedir_get_page (t->pagedir, upage) != NULL)
+    return false;
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return false;
+  p->addr = upage;
+  p->offset = ofs;
+  p->pagedir = t->pagedir;
+  p->frame = NULL;
+  p->read_bytes = read_bytes;
+  p->block_sector = -1;
+  p->status = read_bytes > 0 ? IN_FILESYS : ALL_ZERO;
+  p->is_stack_page = false;
+  p->writable = writable;
+  p->file = file;
+  p->mmapped = mmapped;
+  p->evicting = false;
+  hash_insert (&t->sup_pages, &p->hash_elem);
+  return true;
+}
+
+/* Brings P into a frame and maps it.  Called from the page fault
+   handler.  Returns false if no frame or the read fails. */
+bool page_load (struct page *p)
+{
+  struct frame_entry *f;
+  uint8_t *kpage;
+
+  frame_wait (p);
+  if (p->status == IN_FRAME_TABLE)
+    return true;
+  if (p->status == IN_FILESYS && !p->writable && !p->mmapped)
+    return frame_map_shared (p);
+  f = get_frame ();
+  if (f == NULL)
+    return false;
+  kpage = f->kpage;
+  p->frame = f;
+  switch (p->status)
+    {
+    case IN_FILESYS:
+      if (file_read_at (p->file, kpage, p->read_bytes, p->offset)
+          != (off_t) p->read_bytes)
+        goto fail;
+      memset (kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+      break;
+    case IN_SWAP_TABLE:
+      swap_get (p);
+      p->block_sector = -1;
+      break;
+    default:
+      memset (kpage, 0, PGSIZE);
+      break;
+    }
+  if (!pagedir_set_page (p->pagedir, p->addr, kpage, p->writable))
+    goto fail;
+  p->status = IN_FRAME_TABLE;
+  f->page_occupant = p;
+  return true;
+
+ fail:
+  f->page_occupant = p;
+  free_frame (p);
+  return false;
+}
+
+/* Drops P from the current process, writing it back if it is a
+   modified mapped page. */
+void page_remove (struct page *p)
+{
+  hash_delete (&thread_current ()->sup_pages, &p->hash_elem);
+  page_destructor (&p->hash_elem, NULL);
+}
+
+/* Gives TO, a page of a forked child, its own copy of FROM, a
+   page of the parent that is out in swap. */
+static bool copy_swapped (struct page *from, struct page *to)
+{
+  struct frame_entry *f = get_frame ();
+  if (f == NULL)
+    return false;
+  swap_copy (from, f->kpage);
+  to->frame = f;
+  f->page_occupant = to;
+  if (!pagedir_set_page (to->pagedir, to->addr, f->kpage, to->writable)) {
+    free_frame (to);
+    return false;
+  }
+  to->status = IN_FRAME_TABLE;
+  return true;
+}
+
+/* Copies the pages of PARENT into the current process, a child
+   forked from it while PARENT waits.  Resident pages are shared
+   copy-on-write, so only swapped-out pages are copied now.  Pages
+   read from the executable use EXEC_FILE, the child's own handle.
+   Mapped files are not inherited. */
+bool sup_page_fork (struct thread *parent, struct file *exec_file)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+
+  hash_first (&i, &parent->sup_pages);
+  while (hash_next (&i))
+    {
+      struct page *from = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct page *p;
+
+      if (from->mmapped)
+        continue;
+      p = malloc (sizeof *p);
+      if (p == NULL)
+        return false;
+      *p = *from;
+      p->pagedir = t->pagedir;
+      p->frame = NULL;
+      p->block_sector = -1;
+      p->evicting = false;
+      if (p->file != NULL)
+        p->file = exec_file;
+      hash_insert (&t->sup_pages, &p->hash_elem);
+
+      /* Eviction may move FROM out of its frame at any time, but
+         once out it stays put while PARENT waits. */
+      if (frame_fork (from, p))
+        continue;
+      p->status = from->status;
+      if (p->status == IN_FRAME_TABLE
+          || (p->status == IN_SWAP_TABLE && !copy_swapped (from, p)))
+        return false;
+    }
+  return true;
+}
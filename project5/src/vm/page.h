@@ -7,13 +7,20 @@
 #include "vm/frame.h"
 #include <stdint.h>
 #include <hash.h>
+
+struct thread;
 /* I'll use hash tables (we can choose among array,list,bitmap,and hash table)
  * cause it is efficient for wide range of table sizes*/
 unsigned page_hash (const struct hash_elem *, void *);
 bool page_less (const struct hash_elem *, const struct hash_elem *, void *);
 void page_destructor (struct hash_elem *, void *);
 void sup_page_init (void);
+void sup_page_destroy (void);
 struct page *page_lookup (void *);
+bool page_add_file (void *, struct file *, off_t, size_t, bool, bool);
+bool page_load (struct page *);
+void page_remove (struct page *);
+bool sup_page_fork (struct thread *, struct file *);
 bool page_do_not_remove (void *);
 bool page_allow_remove (void *);
 enum page_status
@@ -36,6 +43,19 @@ struct page
     bool is_stack_page;         
     bool writable;              
     struct file *file;          
+    bool mmapped;               /* Written back to FILE, not swap. */
+    bool evicting;              /* Being written back by an eviction. */
+    struct list_elem share_elem; /* In a shared frame's sharers. */
+  };
+
+/* A file mapped into memory by mmap(). */
+struct mapping
+  {
+    struct list_elem elem;      /* In the thread's mmaps list. */
+    int id;                     /* Mapping id returned to the user. */
+    struct file *file;          /* Own handle, reopened from the fd. */
+    void *addr;                 /* First mapped page. */
+    size_t page_cnt;            /* Number of mapped pages. */
   };
 
 
@@ -28,6 +28,18 @@ void swap_get (struct page *p)
   bitmap_reset (used_blocks, read_sector);
   lock_release (&block_lock);
 }
+/* Reads the swapped-out contents of P into KPAGE, leaving P in
+   swap. */
+void swap_copy (const struct page *p, void *kpage)
+{
+  lock_acquire (&block_lock);
+  char *c = (char *) kpage;
+  for (int i=0; i<8; i++) {
+    block_read (swap_table, p->block_sector*8+i, c);
+    c += 512;
+  }
+  lock_release (&block_lock);
+}
 void swap_insert (struct page *p)
 {
   lock_acquire (&block_lock);
@@ -7,6 +7,7 @@ static struct bitmap *used_blocks;
 struct block *swap_table;
 void swap_init (void);
 void swap_get (struct page *);
+void swap_copy (const struct page *, void *);
 void swap_free (struct page *);
 void swap_insert (struct page *);
 